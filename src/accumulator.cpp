@@ -0,0 +1,106 @@
+#include "accumulator.hpp"
+#include "serialize.hpp"
+#include <cstring>
+
+namespace hydra {
+    void FeatureWeights::load(Eval& net) {
+        torch::NoGradGuard no_grad;
+        torch::Tensor weight = net->fc1->weight.detach().to(at::kCPU).to(at::kFloat).contiguous();
+        torch::Tensor fc1_bias = net->fc1->bias.detach().to(at::kCPU).to(at::kFloat).contiguous();
+        load(weight.data_ptr<float>(), fc1_bias.data_ptr<float>());
+    }
+
+    void FeatureWeights::load(const float* weight, const float* fc1_bias) {
+        //transpose: hidden x input -> input x hidden
+        columns = make_aligned(static_cast<size_t>(INPUT_SIZE) * HIDDEN_SIZE);
+        for (size_t h = 0; h < HIDDEN_SIZE; h++) {
+            for (size_t i = 0; i < INPUT_SIZE; i++) {
+                columns[i * HIDDEN_SIZE + h] = weight[h * INPUT_SIZE + i];
+            }
+        }
+        bias = make_aligned(HIDDEN_SIZE);
+        std::memcpy(bias.get(), fc1_bias, HIDDEN_SIZE * sizeof(float));
+    }
+
+    Accumulator::Accumulator(const FeatureWeights& feature_weights) : weights(feature_weights) {
+    }
+
+    Accumulator::Features Accumulator::features_of(const libchess::Position& pos) {
+        Features features;
+        for (libchess::Color color = libchess::constants::WHITE; color <= libchess::constants::BLACK; color++) {
+            for (libchess::PieceType piece = libchess::constants::PAWN; piece <= libchess::constants::KING; piece++) {
+                features.pieces[color.value()][piece.value()] = pos.piece_type_bb(piece, color);
+            }
+        }
+        features.castling = pos.castling_rights().value();
+        return features;
+    }
+
+    void Accumulator::reset(const libchess::Position& pos) {
+        ply = 0;
+        if (stack.empty()) stack.push_back(make_aligned(2 * HIDDEN_SIZE));
+        for (int perspective = 0; perspective < 2; perspective++) {
+            float* out = &stack[0][perspective * HIDDEN_SIZE];
+            std::memcpy(out, weights.biases(), HIDDEN_SIZE * sizeof(float));
+            std::int16_t features[MAX_ACTIVE_FEATURES];
+            int count = active_features(pos, perspective, features);
+            for (int i = 0; i < count; i++) {
+                const float* column = weights.column(features[i]);
+                for (size_t h = 0; h < HIDDEN_SIZE; h++) out[h] += column[h];
+            }
+        }
+    }
+
+    void Accumulator::make_move(libchess::Position& pos, libchess::Move move) {
+        Features before = features_of(pos);
+        pos.make_move(move);
+        Features after = features_of(pos);
+
+        //features switched on and off by the move (at most a few: captures, castling, promotions)
+        int added[2][8], removed[2][8];
+        int added_cnt = 0, removed_cnt = 0;
+        for (int color = 0; color < 2; color++) {
+            for (int piece = 0; piece < 6; piece++) {
+                libchess::Bitboard changed = before.pieces[color][piece] ^ after.pieces[color][piece];
+                for (; changed; changed.forward_popbit()) {
+                    int square = changed.forward_bitscan().value();
+                    bool on = after.pieces[color][piece] & libchess::Bitboard(square);
+                    int& count = on ? added_cnt : removed_cnt;
+                    for (int perspective = 0; perspective < 2; perspective++) {
+                        (on ? added : removed)[perspective][count] = piece_feature(perspective, color, piece, square);
+                    }
+                    count++;
+                }
+            }
+        }
+        for (int right = 0; right < 4; right++) {
+            if ((before.castling & ~after.castling) & (1 << right)) {
+                for (int perspective = 0; perspective < 2; perspective++) {
+                    removed[perspective][removed_cnt] = castling_feature(perspective, right);
+                }
+                removed_cnt++;
+            }
+        }
+
+        ply++;
+        if (ply == stack.size()) stack.push_back(make_aligned(2 * HIDDEN_SIZE));
+        for (int perspective = 0; perspective < 2; perspective++) {
+            const float* parent = &stack[ply - 1][perspective * HIDDEN_SIZE];
+            float* out = &stack[ply][perspective * HIDDEN_SIZE];
+            std::memcpy(out, parent, HIDDEN_SIZE * sizeof(float));
+            for (int i = 0; i < added_cnt; i++) {
+                const float* column = weights.column(added[perspective][i]);
+                for (size_t h = 0; h < HIDDEN_SIZE; h++) out[h] += column[h];
+            }
+            for (int i = 0; i < removed_cnt; i++) {
+                const float* column = weights.column(removed[perspective][i]);
+                for (size_t h = 0; h < HIDDEN_SIZE; h++) out[h] -= column[h];
+            }
+        }
+    }
+
+    void Accumulator::unmake_move(libchess::Position& pos) {
+        pos.unmake_move();
+        ply--;
+    }
+}
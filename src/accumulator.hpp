@@ -0,0 +1,98 @@
+#pragma once
+
+#include <vector>
+#include <Position.h>
+#include "inference.hpp"
+#include "neural.hpp"
+
+namespace hydra {
+    /**
+     * Weights of the value network's first layer, laid out by input feature so that the contribution of a single
+     * board feature is one contiguous column.
+     */
+    class FeatureWeights {
+        private:
+            aligned_floats columns;                                                             //INPUT_SIZE x HIDDEN_SIZE
+            aligned_floats bias;
+
+        public:
+            /**
+             * Copies the first layer of a trained network.
+             * @param {Eval&} net - the value network.
+             */
+            void load(Eval& net);
+
+            /**
+             * Copies first layer weights.
+             * @param {const float*} weight - HIDDEN_SIZE x INPUT_SIZE weights, as stored by torch::nn::Linear.
+             * @param {const float*} fc1_bias - HIDDEN_SIZE biases.
+             */
+            void load(const float* weight, const float* fc1_bias);
+
+            const float* column(int feature) const {
+                return &columns[static_cast<size_t>(feature) * HIDDEN_SIZE];
+            }
+
+            const float* biases() const {
+                return bias.get();
+            }
+    };
+
+    /**
+     * First layer pre-activations of the positions along a search path, from both sides' point of view (the network
+     * sees the board from the side to move). Moves only change a handful of input features, so each ply is derived
+     * from its parent by adding and subtracting weight columns instead of recomputing the whole layer. Every ply has
+     * its own slot, so unmaking a move is exact and free.
+     */
+    class Accumulator {
+        private:
+            /**
+             * Piece bitboards and castling rights, captured before a move to find the features it changes.
+             */
+            struct Features {
+                libchess::Bitboard pieces[2][6];
+                int castling;
+            };
+
+            const FeatureWeights& weights;
+
+            /**
+             * One slot per ply: white perspective followed by black perspective.
+             */
+            std::vector<aligned_floats> stack;
+            size_t ply{ 0 };
+
+            static Features features_of(const libchess::Position& pos);
+
+        public:
+            explicit Accumulator(const FeatureWeights& feature_weights);
+
+            /**
+             * Computes the pre-activations of a position from scratch and makes it the bottom of the stack.
+             * @param {const libchess::Position&} pos - root position.
+             */
+            void reset(const libchess::Position& pos);
+
+            /**
+             * Makes a move and updates the pre-activations incrementally.
+             * @param {libchess::Position&} pos - the current position.
+             * @param {libchess::Move} move - the move to make.
+             */
+            void make_move(libchess::Position& pos, libchess::Move move);
+
+            /**
+             * Unmakes the last move and restores the parent's pre-activations.
+             * @param {libchess::Position&} pos - the current position.
+             */
+            void unmake_move(libchess::Position& pos);
+
+            /**
+             * Pre-activations of the current position.
+             * @param {libchess::Color} perspective - the side to move.
+             * @returns {const float*} HIDDEN_SIZE first layer outputs before the activation.
+             */
+            const float* pre_activations(libchess::Color perspective) const {
+                return &stack[ply][perspective == libchess::constants::WHITE ? 0 : HIDDEN_SIZE];
+            }
+    };
+}
@@ -0,0 +1,231 @@
+#include "checkpoint.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace hydra {
+    namespace {
+        constexpr const char* CHECKPOINT_PREFIX = "checkpoint-";
+        constexpr const char* CHECKPOINT_SUFFIX = ".pt";
+
+        /**
+         * Epoch checkpoints in a directory.
+         * @param {const std::string&} directory - checkpoint directory.
+         * @returns {std::vector<std::filesystem::path>} the files, oldest first.
+         */
+        std::vector<std::filesystem::path> list_checkpoints(const std::string& directory) {
+            std::vector<std::filesystem::path> found;
+            std::error_code error;
+            for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+                std::string name = entry.path().filename().string();
+                if (name.size() > 14 && name.compare(0, 11, CHECKPOINT_PREFIX) == 0 && name.compare(name.size() - 3, 3, CHECKPOINT_SUFFIX) == 0) {
+                    found.push_back(entry.path());
+                }
+            }
+            //epochs are zero padded, so name order is epoch order
+            std::sort(found.begin(), found.end());
+            return found;
+        }
+
+        /**
+         * Flushes a file or directory to disk.
+         * @param {const std::string&} path - the file or directory.
+         * @returns {bool} true on success.
+         */
+        bool flush_to_disk(const std::string& path) {
+#ifdef _WIN32
+            //directories cannot be opened for writing; NTFS journals the rename itself
+            HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                                      FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) return std::filesystem::is_directory(path);
+            bool flushed = FlushFileBuffers(file) != 0;
+            CloseHandle(file);
+            return flushed;
+#else
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) return false;
+            bool flushed = fsync(fd) == 0;
+            close(fd);
+            return flushed;
+#endif
+        }
+
+        /**
+         * Writes a file through a temporary file, so readers see either the old or the new file in full.
+         * @param {const std::string&} path - destination.
+         * @param {const std::function<void(const std::string&)>&} write_file - writes the contents to the path it is given.
+         */
+        void replace_file(const std::string& path, const std::function<void(const std::string&)>& write_file) {
+            std::string temporary = path + ".tmp";
+            write_file(temporary);
+            if (!flush_to_disk(temporary)) throw std::runtime_error("cannot flush " + temporary);
+            std::filesystem::rename(temporary, path);
+            std::filesystem::path parent = std::filesystem::path(path).parent_path();
+            flush_to_disk(parent.empty() ? "." : parent.string());
+        }
+
+        /**
+         * Copies a tensor into a CPU snapshot, allocating the snapshot on first use.
+         * @param {const torch::Tensor&} source - tensor on any device.
+         * @param {torch::Tensor} target - previous snapshot, or undefined.
+         * @returns {torch::Tensor} the snapshot.
+         */
+        torch::Tensor snapshot(const torch::Tensor& source, torch::Tensor target) {
+            if (!source.defined()) return {};
+            if (!target.defined()) target = torch::empty(source.sizes(), source.options().device(torch::kCPU));
+            target.copy_(source);
+            return target;
+        }
+    }
+
+    Checkpointer::Checkpointer(const std::string& path, int count) : directory(path), keep(std::max(count, 1)) {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+    }
+
+    void load_weights(Eval net, const std::string& path) {
+        torch::NoGradGuard no_grad;
+        torch::serialize::InputArchive archive;
+        archive.load_from(path);
+        auto read_layer = [&](const char* name, torch::nn::Linear& fc) {
+            torch::serialize::InputArchive layer;
+            if (!archive.try_read(name, layer)) return false;
+            layer.read("weight", fc->weight);
+            layer.read("bias", fc->bias);
+            return true;
+        };
+        std::pair<const char*, torch::nn::Linear*> value_layers[] = { { "fc1", &net->fc1 }, { "fc2", &net->fc2 }, { "fc3", &net->fc3 }, { "fc4", &net->fc4 } };
+        for (auto& layer : value_layers) {
+            if (!read_layer(layer.first, *layer.second)) throw std::runtime_error(path + " has no " + layer.first + " layer");
+        }
+        //without the flag the head counts as untrained
+        if (read_layer("policy", net->policy)) archive.try_read("policy_trained", net->policy_trained, true);
+    }
+
+    Checkpointer::~Checkpointer() {
+        wait();
+    }
+
+    void Checkpointer::wait() {
+        if (writer.joinable()) writer.join();
+    }
+
+    void Checkpointer::save(Eval net, torch::optim::Adam& optimizer, int epoch, float best_loss, bool best) {
+        wait();
+
+        torch::NoGradGuard no_grad;
+        if (shadow.is_empty()) {
+            shadow = Eval();
+            shadow_optimizer = std::make_unique<torch::optim::Adam>(shadow->parameters(),
+                static_cast<const torch::optim::AdamOptions&>(optimizer.defaults()));
+        }
+
+        //weights, buffers and optimizer state are copied in place; the training loop resumes as soon as this returns
+        std::vector<torch::Tensor> source_buffers = net->buffers();
+        std::vector<torch::Tensor> target_buffers = shadow->buffers();
+        for (size_t i = 0; i < source_buffers.size(); i++) {
+            target_buffers[i].copy_(source_buffers[i]);
+        }
+        std::vector<torch::Tensor> source = net->parameters();
+        std::vector<torch::Tensor> target = shadow->parameters();
+        auto& states = optimizer.state();
+        auto& shadow_states = shadow_optimizer->state();
+        for (size_t i = 0; i < source.size(); i++) {
+            target[i].copy_(source[i]);
+
+            auto found = states.find(source[i].unsafeGetTensorImpl());
+            if (found == states.end()) continue;
+            auto& state = static_cast<torch::optim::AdamParamState&>(*found->second);
+            auto& copy = shadow_states[target[i].unsafeGetTensorImpl()];
+            if (!copy) copy = std::make_unique<torch::optim::AdamParamState>();
+            auto& shadow_state = static_cast<torch::optim::AdamParamState&>(*copy);
+            shadow_state.step(state.step());
+            shadow_state.exp_avg(snapshot(state.exp_avg(), shadow_state.exp_avg()));
+            shadow_state.exp_avg_sq(snapshot(state.exp_avg_sq(), shadow_state.exp_avg_sq()));
+            shadow_state.max_exp_avg_sq(snapshot(state.max_exp_avg_sq(), shadow_state.max_exp_avg_sq()));
+        }
+
+        writer = std::thread(&Checkpointer::write, this, epoch, best_loss, best);
+    }
+
+    void Checkpointer::write(int epoch, float best_loss, bool best) {
+        try {
+            torch::serialize::OutputArchive archive, model, state;
+            shadow->save(model);
+            shadow_optimizer->save(state);
+            archive.write("model", model);
+            archive.write("optimizer", state);
+            archive.write("epoch", torch::tensor(static_cast<int64_t>(epoch)));
+            archive.write("best_loss", torch::tensor(best_loss));
+
+            char name[32];
+            std::snprintf(name, sizeof(name), "%s%05d%s", CHECKPOINT_PREFIX, epoch, CHECKPOINT_SUFFIX);
+            replace_file(directory + name, [&](const std::string& path) { archive.save_to(path); });
+            rotate();
+
+            if (best) {
+                replace_file(directory + "evaluator.pt", [&](const std::string& path) { torch::save(shadow, path); });
+            }
+        }
+        catch (const std::exception& e) {
+            std::cout << "Could not write checkpoint: " << e.what() << "\n";
+        }
+    }
+
+    void Checkpointer::rotate() {
+        std::vector<std::filesystem::path> found = list_checkpoints(directory);
+        std::error_code error;
+        for (size_t i = 0; i + keep < found.size(); i++) {
+            std::filesystem::remove(found[i], error);
+        }
+    }
+
+    int Checkpointer::resume(Eval net, torch::optim::Adam& optimizer, torch::Device device, float& best_loss) {
+        std::vector<std::filesystem::path> found = list_checkpoints(directory);
+        if (found.empty()) {
+            //weights only
+            std::string weights = directory + "evaluator.pt";
+            if (std::filesystem::exists(weights)) {
+                load_weights(net, weights);
+                net->to(device);
+                std::cout << "Loaded weights from " << weights << ".\n";
+            }
+            return 0;
+        }
+
+        torch::serialize::InputArchive archive, model, state;
+        archive.load_from(found.back().string());
+        archive.read("model", model);
+        //restores the parameters and buffers (whether the policy head trained)
+        net->load(model);
+        net->to(device);
+        archive.read("optimizer", state);
+        optimizer.load(state);
+
+        //optimizer state is loaded on the CPU
+        for (auto& entry : optimizer.state()) {
+            auto& param_state = static_cast<torch::optim::AdamParamState&>(*entry.second);
+            param_state.exp_avg(param_state.exp_avg().to(device));
+            param_state.exp_avg_sq(param_state.exp_avg_sq().to(device));
+            if (param_state.max_exp_avg_sq().defined()) param_state.max_exp_avg_sq(param_state.max_exp_avg_sq().to(device));
+        }
+
+        torch::Tensor epoch, loss;
+        archive.read("epoch", epoch);
+        archive.read("best_loss", loss);
+        best_loss = loss.item<float>();
+        std::cout << "Resumed from " << found.back().string() << ".\n";
+        return static_cast<int>(epoch.item<int64_t>());
+    }
+}
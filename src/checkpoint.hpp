@@ -0,0 +1,97 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <torch/torch.h>
+#include "neural.hpp"
+
+namespace hydra {
+    /**
+     * Loads network weights saved with torch::save, such as evaluator.pt. Files written before the policy head, or
+     * before it recorded whether it trained, still load: the head is then left untrained and the search keeps uniform
+     * priors.
+     * @param {Eval} net - the network.
+     * @param {const std::string&} path - weights file.
+     */
+    void load_weights(Eval net, const std::string& path);
+
+    /**
+     * Writes training checkpoints without stalling the training loop. Saving copies the weights and the optimizer
+     * state into a CPU shadow network and optimizer, which are allocated once and reused. A background thread then
+     * serializes them to a temporary file, flushes it to disk and renames it into place, so a crash never leaves a
+     * truncated checkpoint. Every epoch writes checkpoint-<epoch>.pt (weights, optimizer state, epoch and best loss)
+     * and only the newest few are kept. An improved loss also replaces evaluator.pt, the weights the engine plays with.
+     */
+    class Checkpointer {
+        private:
+            std::string directory;
+            int keep;
+
+            /**
+             * Snapshot being written.
+             */
+            Eval shadow{ nullptr };
+            std::unique_ptr<torch::optim::Adam> shadow_optimizer;
+
+            /**
+             * Background writer of the last snapshot.
+             */
+            std::thread writer;
+
+            /**
+             * Serializes the snapshot (runs on the writer thread).
+             * @param {int} epoch - epoch of the snapshot.
+             * @param {float} best_loss - best epoch loss so far.
+             * @param {bool} best - also replace evaluator.pt.
+             */
+            void write(int epoch, float best_loss, bool best);
+
+            /**
+             * Deletes all but the newest checkpoints.
+             */
+            void rotate();
+
+        public:
+            /**
+             * @param {const std::string&} path - directory of the checkpoints.
+             * @param {int} count - number of epoch checkpoints to keep.
+             */
+            Checkpointer(const std::string& path, int count);
+
+            /**
+             * Waits for the last write.
+             */
+            ~Checkpointer();
+
+            Checkpointer(const Checkpointer&) = delete;
+            Checkpointer& operator=(const Checkpointer&) = delete;
+
+            /**
+             * Snapshots the network and its optimizer and writes them in the background. Waits for the previous write
+             * first, which has normally finished long before.
+             * @param {Eval} net - the network being trained, on any device.
+             * @param {torch::optim::Adam&} optimizer - its optimizer.
+             * @param {int} epoch - the finished epoch.
+             * @param {float} best_loss - best epoch loss so far.
+             * @param {bool} best - this epoch improved the loss, so also replace evaluator.pt.
+             */
+            void save(Eval net, torch::optim::Adam& optimizer, int epoch, float best_loss, bool best);
+
+            /**
+             * Waits until the last snapshot is on disk.
+             */
+            void wait();
+
+            /**
+             * Restores the newest checkpoint: weights, optimizer state, epoch and best loss. Without one, only the
+             * weights of evaluator.pt are loaded, if present.
+             * @param {Eval} net - the network, already on the training device.
+             * @param {torch::optim::Adam&} optimizer - its optimizer.
+             * @param {torch::Device} device - the training device.
+             * @param {float&} best_loss - receives the best epoch loss of the checkpoint.
+             * @returns {int} the epoch of the checkpoint, 0 if training starts over.
+             */
+            int resume(Eval net, torch::optim::Adam& optimizer, torch::Device device, float& best_loss);
+    };
+}
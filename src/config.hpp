@@ -8,12 +8,42 @@ namespace hydra {
         //MCTS search parameters.
         constexpr int           MCTS_ITERATIONS = 16000;
         constexpr int           THREAD_CNT      = 2;
-        constexpr float         C_PUCT          = 0.01;
+        constexpr float         C_PUCT          = 1.5;      //exploration weight of the move priors
+        constexpr float         FPU_REDUCTION   = 0.2;      //unvisited moves are valued at the parent's value less this
+        constexpr int           INFLIGHT_LEAVES = 8;        //leaves each thread descends to before waiting on evaluations
+        constexpr int           VIRTUAL_LOSS    = 3;
+        constexpr int           HASH_MB         = 256;      //search tree memory budget (MiB)
+        constexpr bool          TRANSPOSITIONS  = true;     //share nodes between transpositions
+        constexpr int           TT_SHARE        = 32;       //fraction of the budget used by the transposition table (1/n)
+        constexpr bool          CUDA_INFERENCE  = false;    //evaluate with libtorch on the GPU when available (otherwise native CPU kernels)
+        constexpr bool          INT8_INFERENCE  = true;     //evaluate with the quantized network (evaluator.q8) when present
+        //Time management parameters.
+        constexpr int           MOVE_OVERHEAD   = 30;       //time reserved per move for GUI communication (milliseconds)
+        constexpr int           MOVES_TO_GO     = 30;       //moves the remaining clock is spread over without movestogo
+        constexpr float         HARD_TIME_RATIO = 4;        //a move may overrun its target time this many times while unstable
+        constexpr double        KLD_GAIN_MIN    = 0;        //stop when the root visit distribution changes less than this per playout (0 to disable)
+        constexpr int           KLD_INTERVAL    = 1000;     //playouts between KLD gain checks
+        //NN evaluation queue parameters.
+        constexpr int           EVAL_BATCH_SIZE = THREAD_CNT * INFLIGHT_LEAVES;
+        constexpr int           EVAL_CACHE_MB   = 32;       //NN evaluation cache size (MiB)
+        constexpr int           EVAL_FLUSH_US   = 200;      //partial batch flush timeout (microseconds)
         //NN training parameters.
         constexpr int           NUM_EPOCH       = 25;
         constexpr int           BATCH_SIZE      = 1024;
+        constexpr float         POLICY_WEIGHT   = 1;        //weight of the policy cross entropy in the training loss (0 to train the value only)
         constexpr int           LOG_INTERVAL    = 10;
-        constexpr bool          LOAD_CHECKPOINT = false;
+        constexpr bool          LOAD_CHECKPOINT = false;    //resume from the newest checkpoint (or the weights in evaluator.pt)
+        constexpr int           CHECKPOINTS     = 3;        //epoch checkpoints kept on disk
+        constexpr bool          SPARSE_INPUT    = true;     //train on sparse feature lists (embedding bag first layer)
+        constexpr bool          MIRROR_AUGMENT  = true;     //mirror the files of half of the training positions without castling rights
+        constexpr int           TRAIN_REPLICAS  = 0;        //CPU training model replicas (0 for one per NUMA node, 1 to disable)
+        constexpr int           VALID_THREADS   = 4;        //threads of the validation pass
+        constexpr int           VALID_BATCH     = 8192;     //examples per validation batch
+        constexpr int           VALID_INTERVAL  = 0;        //also validate every this many batches (0 for once per epoch)
+        constexpr int           LOADER_WORKERS  = 4;        //data loader threads for dataset files
+        constexpr int           STREAM_THREADS  = 4;        //prefetch threads when streaming a directory of shards
+        constexpr int           SHUFFLE_BUFFER  = 1 << 20;  //examples held in the streaming shuffle buffer
+        constexpr int           SEED            = 42;       //seed of the streaming shard order, shuffle and augmentation
         constexpr const char*   WEIGHTS_PATH    = ".\\data\\";
     }
 }
\ No newline at end of file
@@ -1,18 +1,86 @@
 #pragma once
 
 #include "serialize.hpp"
+#include "packed.hpp"
+#include "config.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <memory>
+#include <random>
 #include <torch/torch.h>
 #include <Position.h>
 
 namespace hydra {
+    /**
+     * Columns of a target row: the evaluation, and the policy index of the best move (-1 if unlabelled).
+     */
+    constexpr int TARGET_SCORE = 0;
+    constexpr int TARGET_MOVE = 1;
+
+    /**
+     * Small id of the calling thread, distinct for every thread that decodes batches.
+     * @returns {unsigned} thread id.
+     */
+    inline unsigned decode_thread_id() {
+        static std::atomic<unsigned> next{ 0 };
+        thread_local unsigned id = next.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+
+    /**
+     * Decodes a batch of examples straight into one contiguous input tensor and one target tensor, so a batch costs
+     * two allocations instead of two per example plus a stacking copy.
+     * @param {size_t} count - number of examples.
+     * @param {bool} sparse - rows of MAX_ACTIVE_FEATURES int16 feature indices padded with -1 (see Eval::forward_padded)
+     * instead of dense INPUT_SIZE float rows.
+     * @param {bool} augment - mirror the files of a random half of the positions without castling rights.
+     * @param {int} epoch - current epoch, so every epoch mirrors different positions.
+     * @param {Decode} decode - decode(i, features, score, move) writes the active features, the score and the best
+     * move's policy index (-1 if unknown) of example i and returns the number of features.
+     * @returns {torch::data::Example<>} the batch.
+     */
+    template <typename Decode>
+    torch::data::Example<> decode_batch(size_t count, bool sparse, bool augment, int epoch, Decode decode) {
+        const int64_t rows = static_cast<int64_t>(count);
+        torch::Tensor inputs = sparse ? torch::full({ rows, MAX_ACTIVE_FEATURES }, -1, at::kShort) : torch::zeros({ rows, INPUT_SIZE });
+        torch::Tensor targets = torch::empty({ rows, 2 });
+        std::int16_t* sparse_rows = sparse ? inputs.data_ptr<std::int16_t>() : nullptr;
+        float* dense_rows = sparse ? nullptr : inputs.data_ptr<float>();
+        float* target_rows = targets.data_ptr<float>();
+
+        //loader workers decode batches concurrently, each from its own stream reseeded every epoch
+        thread_local std::minstd_rand rng;
+        thread_local int rng_epoch = -1;
+        if (augment && rng_epoch != epoch) {
+            std::seed_seq seed{ static_cast<unsigned>(config::SEED), decode_thread_id(), static_cast<unsigned>(epoch) };
+            rng.seed(seed);
+            rng_epoch = epoch;
+        }
+        for (size_t i = 0; i < count; i++) {
+            std::int16_t features[MAX_ACTIVE_FEATURES];
+            int move = -1;
+            int active = decode(i, features, target_rows[i * 2 + TARGET_SCORE], move);
+            if (augment && (rng() & 1) && mirror_files(features, active) && move >= 0) move = mirror_policy(move);
+            target_rows[i * 2 + TARGET_MOVE] = static_cast<float>(move);
+            if (sparse) {
+                std::copy(features, features + active, sparse_rows + i * MAX_ACTIVE_FEATURES);
+            }
+            else {
+                for (int f = 0; f < active; f++) dense_rows[i * INPUT_SIZE + features[f]] = 1;
+            }
+        }
+        return { inputs, targets };
+    }
+
     /**
      * Custom dataset loader for chess positions and their evaluations with a third-party engine.
      * As the chess engine evaluations also contain lookahead search (commonly alpha-beta), 
      * hopefully the result is a learned evaluation that contains lookahead charactaristics. 
      */
-    class PositionDataset : public torch::data::Dataset<PositionDataset>
+    class PositionDataset : public torch::data::BatchDataset<PositionDataset, torch::data::Example<>>
     {
-        using DataType = std::vector<std::tuple<std::string, float>>;
+        using DataType = std::vector<std::tuple<std::string, float, int>>;
         private:
             /**
              * Stored CSV parsed data.
@@ -20,9 +88,24 @@ namespace hydra {
             DataType csv_;
 
             /**
-             * Reads CSV file containing move + evaluation data. 
+             * Return sparse feature lists rather than dense board tensors.
+             */
+            bool sparse_;
+
+            /**
+             * Randomly mirror positions without castling rights.
+             */
+            bool augment_;
+
+            /**
+             * Current epoch of the augmentation, shared by the copies of the dataset the loader workers hold.
+             */
+            std::shared_ptr<std::atomic<int>> epoch_{ std::make_shared<std::atomic<int>>(0) };
+
+            /**
+             * Reads CSV file containing position + evaluation data, with an optional best move in UCI notation.
              * @param {const std::string&} location - file path.
-             * @returns {DataType} parsed data.
+             * @returns {DataType} parsed data (the best move as a policy index from white's point of view, or -1).
              */ 
             DataType ReadCSV(const std::string& location) {
                 DataType csv;
@@ -31,35 +114,55 @@ namespace hydra {
                 std::string line;
                 std::string pos;
                 std::string score;
+                std::string move;
 
                 while (std::getline(in, line)) {
                     std::stringstream postream{line};
                     std::getline(postream, pos, ',');
                     std::getline(postream, score, ',');
-                    csv.push_back(std::make_tuple(pos, std::stof(score)));
+                    move.clear();
+                    std::getline(postream, move, ',');
+                    move.erase(std::remove_if(move.begin(), move.end(), [](char c) { return std::isspace(static_cast<unsigned char>(c)); }), move.end());
+                    csv.push_back(std::make_tuple(pos, std::stof(score), parse_move_index(move.data(), move.data() + move.size())));
                 }
 
                 return csv;
             }
 
         public:
-            explicit PositionDataset(const std::string& file_name_csv) : csv_(ReadCSV(file_name_csv)) {}
+            /**
+             * @param {const std::string&} file_name_csv - file path.
+             * @param {bool} sparse - serialize examples as MAX_ACTIVE_FEATURES int16 feature indices padded with -1
+             * (see Eval::forward_padded) instead of dense INPUT_SIZE float tensors.
+             * @param {bool} augment - randomly mirror the files of positions without castling rights.
+             */
+            explicit PositionDataset(const std::string& file_name_csv, bool sparse = config::SPARSE_INPUT, bool augment = false)
+                : csv_(ReadCSV(file_name_csv)), sparse_(sparse), augment_(augment) {}
 
             /**
-             * Get training example.
-             * @param {size_t} index - example index.
-             * @returns {torch::data::Example<>} training example.
-             */ 
-            torch::data::Example<> get(size_t index) override {
-                libchess::Position pos{std::get<0>(csv_[index])};
-                float score = std::get<1>(csv_[index]);
-                //if (pos.side_to_move() == libchess::constants::BLACK) score *= -1; //flip score
-                //float certainty = std::min(5, pos.fullmoves()) / 5.0; //reduce certainty in early game
-                //score *= certainty;
-
-                torch::Tensor board_tensor = serialize(pos);
-                torch::Tensor score_tensor = torch::full({1}, score);
-                return {board_tensor, score_tensor};
+             * Get a batch of training examples.
+             * @param {torch::ArrayRef<size_t>} indices - example indices.
+             * @returns {torch::data::Example<>} the examples, one row each.
+             */
+            torch::data::Example<> get_batch(torch::ArrayRef<size_t> indices) override {
+                return decode_batch(indices.size(), sparse_, augment_, epoch_->load(std::memory_order_relaxed), [&](size_t i, std::int16_t* features, float& score, int& move) {
+                    libchess::Position pos{std::get<0>(csv_[indices[i]])};
+                    score = std::get<1>(csv_[indices[i]]);
+                    int best_move = std::get<2>(csv_[indices[i]]);
+                    if (best_move >= 0) move = policy_index(pos.side_to_move().value(), best_move / 64, best_move % 64);
+                    //if (pos.side_to_move() == libchess::constants::BLACK) score *= -1; //flip score
+                    //float certainty = std::min(5, pos.fullmoves()) / 5.0; //reduce certainty in early game
+                    //score *= certainty;
+                    return serialize_sparse(pos, features);
+                });
+            }
+
+            /**
+             * Epoch counter of the augmentation. It can be kept to advance the epoch once the loader owns the dataset.
+             * @returns {std::shared_ptr<std::atomic<int>>} the counter.
+             */
+            std::shared_ptr<std::atomic<int>> epoch_counter() const {
+                return epoch_;
             }
 
             /**
@@ -70,4 +173,76 @@ namespace hydra {
                 return csv_.size();
             }
     };   
+
+    /**
+     * Dataset in the packed binary format (see convert_to_packed). The file is memory mapped, so loading is
+     * instant and memory use is bounded by the page cache; records are decoded straight into tensors.
+     */
+    class PackedDataset : public torch::data::BatchDataset<PackedDataset, torch::data::Example<>>
+    {
+        private:
+            /**
+             * Mapped file, shared by copies of the dataset.
+             */
+            std::shared_ptr<MappedFile> file_;
+            const PackedPosition* records_;
+            size_t count_;
+
+            /**
+             * Return sparse feature lists rather than dense board tensors.
+             */
+            bool sparse_;
+
+            /**
+             * Randomly mirror positions without castling rights.
+             */
+            bool augment_;
+
+            /**
+             * Current epoch of the augmentation, shared by the copies of the dataset the loader workers hold.
+             */
+            std::shared_ptr<std::atomic<int>> epoch_{ std::make_shared<std::atomic<int>>(0) };
+
+        public:
+            /**
+             * @param {const std::string&} file_name - packed file path.
+             * @param {bool} sparse - decode examples as MAX_ACTIVE_FEATURES int16 feature indices padded with -1
+             * instead of dense INPUT_SIZE float tensors.
+             * @param {bool} augment - randomly mirror the files of positions without castling rights.
+             */
+            explicit PackedDataset(const std::string& file_name, bool sparse = config::SPARSE_INPUT, bool augment = false)
+                : file_(std::make_shared<MappedFile>(file_name)), sparse_(sparse), augment_(augment) {
+                records_ = packed_records(*file_, count_);
+            }
+
+            /**
+             * Get a batch of training examples.
+             * @param {torch::ArrayRef<size_t>} indices - example indices.
+             * @returns {torch::data::Example<>} the examples, one row each.
+             */
+            torch::data::Example<> get_batch(torch::ArrayRef<size_t> indices) override {
+                return decode_batch(indices.size(), sparse_, augment_, epoch_->load(std::memory_order_relaxed), [&](size_t i, std::int16_t* features, float& score, int& move) {
+                    const PackedPosition& record = records_[indices[i]];
+                    score = record.score;
+                    move = packed_move(record);
+                    return unpack_sparse(record, features);
+                });
+            }
+
+            /**
+             * Epoch counter of the augmentation. It can be kept to advance the epoch once the loader owns the dataset.
+             * @returns {std::shared_ptr<std::atomic<int>>} the counter.
+             */
+            std::shared_ptr<std::atomic<int>> epoch_counter() const {
+                return epoch_;
+            }
+
+            /**
+             * Size of training set.
+             * @returns {torch::optional<size_t>} size of training set.
+             */
+            torch::optional<size_t> size() const override {
+                return count_;
+            }
+    };
 }
\ No newline at end of file
@@ -0,0 +1,49 @@
+#include "evalcache.hpp"
+#include <cstring>
+
+namespace hydra {
+    void EvalCache::resize(size_t bytes) {
+        size_t count = 1;
+        while (count * 2 * sizeof(Entry) <= bytes) count *= 2;
+        entries = std::make_unique<Entry[]>(count);
+        mask = count - 1;
+        clear();
+    }
+
+    void EvalCache::clear() {
+        for (size_t i = 0; i <= mask; i++) {
+            entries[i].check.store(0, std::memory_order_relaxed);
+            entries[i].data.store(0, std::memory_order_relaxed);
+        }
+        probes = 0;
+        hits = 0;
+    }
+
+    bool EvalCache::probe(libchess::Position::hash_type hash, float& value) {
+        probes.fetch_add(1, std::memory_order_relaxed);
+        const Entry& entry = entries[hash & mask];
+        std::uint64_t data = entry.data.load(std::memory_order_relaxed);
+        //an empty slot never verifies against a nonzero hash
+        if (hash == 0 || (entry.check.load(std::memory_order_relaxed) ^ data) != hash) return false;
+        std::uint32_t bits = static_cast<std::uint32_t>(data);
+        std::memcpy(&value, &bits, sizeof(value));
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void EvalCache::store(libchess::Position::hash_type hash, float value) {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        Entry& entry = entries[hash & mask];
+        entry.check.store(hash ^ bits, std::memory_order_relaxed);
+        entry.data.store(bits, std::memory_order_relaxed);
+    }
+
+    std::uint64_t EvalCache::probe_count() const {
+        return probes.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t EvalCache::hit_count() const {
+        return hits.load(std::memory_order_relaxed);
+    }
+}
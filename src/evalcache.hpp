@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <Position.h>
+
+namespace hydra {
+    /**
+     * Fixed-size cache of value network evaluations indexed by position hash. Shared by all search threads and kept
+     * across moves. Lock-free: each entry stores its key xor-ed with its data, so a torn write from a racing thread
+     * fails verification and reads as a miss instead of returning another position's value.
+     */
+    class EvalCache {
+        private:
+            struct Entry {
+                std::atomic<std::uint64_t> check{ 0 };                                          //key ^ data
+                std::atomic<std::uint64_t> data{ 0 };                                           //value bits
+            };
+
+            std::unique_ptr<Entry[]> entries;
+            size_t mask{ 0 };
+
+            /**
+             * Lookup statistics since the last clear.
+             */
+            std::atomic<std::uint64_t> probes{ 0 };
+            std::atomic<std::uint64_t> hits{ 0 };
+
+        public:
+            /**
+             * Allocates the cache and clears it.
+             * @param {size_t} bytes - memory to use. Rounded down to a power of two number of entries.
+             */
+            void resize(size_t bytes);
+
+            /**
+             * Empties the cache and its statistics. Must not be called while other threads use the cache.
+             */
+            void clear();
+
+            /**
+             * Looks up the evaluation of a position.
+             * @param {libchess::Position::hash_type} hash - position hash.
+             * @param {float&} value - receives the evaluation on a hit.
+             * @returns {bool} true on a hit.
+             */
+            bool probe(libchess::Position::hash_type hash, float& value);
+
+            /**
+             * Stores the evaluation of a position, replacing whatever shared its slot.
+             * @param {libchess::Position::hash_type} hash - position hash.
+             * @param {float} value - the network evaluation.
+             */
+            void store(libchess::Position::hash_type hash, float value);
+
+            /**
+             * Number of lookups since the last clear.
+             * @returns {std::uint64_t} lookup count.
+             */
+            std::uint64_t probe_count() const;
+
+            /**
+             * Number of successful lookups since the last clear.
+             * @returns {std::uint64_t} hit count.
+             */
+            std::uint64_t hit_count() const;
+    };
+}
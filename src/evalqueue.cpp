@@ -0,0 +1,72 @@
+#include "evalqueue.hpp"
+#include <cstring>
+
+namespace hydra {
+    EvalQueue::EvalQueue(Backend net_backend, EvalCache* result_cache, size_t width, size_t max_batch, std::chrono::microseconds timeout)
+        : backend(std::move(net_backend)), cache(result_cache), input_size(width), batch_size(max_batch), flush_timeout(timeout),
+          inputs{ BatchBuffer(max_batch, width), BatchBuffer(max_batch, width) } {
+        pending.reserve(batch_size);
+        batch_outputs.resize(batch_size);
+        worker = std::thread(&EvalQueue::run, this);
+    }
+
+    EvalQueue::~EvalQueue() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+
+    std::future<float> EvalQueue::submit(const float* input, libchess::Position::hash_type hash) {
+        Request request;
+        request.hash = hash;
+        std::future<float> result = request.result.get_future();
+        bool wake;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            space.wait(lock, [&]() { return pending.size() < batch_size; });
+            std::memcpy(inputs[filling].slot(pending.size()), input, input_size * sizeof(float));
+            request.arrival = std::chrono::steady_clock::now();
+            pending.push_back(std::move(request));
+            //only wake the worker when it needs to arm its timeout or has a full batch
+            wake = pending.size() == 1 || pending.size() >= batch_size;
+        }
+        if (wake) cv.notify_one();
+        return result;
+    }
+
+    void EvalQueue::run() {
+        std::vector<Request> batch;
+        batch.reserve(batch_size);
+        int flushing;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() { return !pending.empty() || !running; });
+                if (pending.empty()) return; //shut down
+
+                //give other descents a chance to fill the batch
+                cv.wait_until(lock, pending.front().arrival + flush_timeout, [&]() { return pending.size() >= batch_size || !running; });
+
+                //take the whole filling buffer, submitters move on to the other one
+                batch.swap(pending);
+                flushing = filling;
+                filling ^= 1;
+            }
+            space.notify_all();
+            flush(batch, inputs[flushing]);
+            batch.clear();
+        }
+    }
+
+    void EvalQueue::flush(std::vector<Request>& batch, const BatchBuffer& batch_inputs) {
+        //NN evaluation
+        backend(batch_inputs, batch_outputs.data(), batch.size());
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (cache != nullptr) cache->store(batch[i].hash, batch_outputs[i]);
+            batch[i].result.set_value(batch_outputs[i]);
+        }
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <Position.h>
+#include "evalcache.hpp"
+#include "serialize.hpp"
+
+namespace hydra {
+    /**
+     * Collects leaf positions from in-flight MCTS descents and evaluates them with the value network in batches.
+     * A batch is flushed once it reaches the configured size, or once the oldest queued leaf has waited for the
+     * flush timeout, so a lone search thread never stalls waiting for company.
+     */
+    class EvalQueue {
+        public:
+            /**
+             * Evaluates a batch: (inputs, one row per position, outputs, batch size).
+             */
+            using Backend = std::function<void(const BatchBuffer&, float*, size_t)>;
+
+        private:
+            /**
+             * A queued leaf awaiting evaluation.
+             */
+            struct Request {
+                libchess::Position::hash_type hash;                 //position hash for the cache
+                std::promise<float> result;                         //network evaluation
+                std::chrono::steady_clock::time_point arrival;      //time queued
+            };
+
+            /**
+             * Value network forward pass.
+             */
+            Backend backend;
+
+            /**
+             * Receives every evaluation (nullptr for none).
+             */
+            EvalCache* cache;
+
+            /**
+             * Floats per network input.
+             */
+            size_t input_size;
+
+            /**
+             * Maximum number of leaves per network call.
+             */
+            size_t batch_size;
+
+            /**
+             * Maximum time the oldest queued leaf may wait before a partial batch is flushed.
+             */
+            std::chrono::microseconds flush_timeout;
+
+            /**
+             * Leaves waiting for the next batch. Their inputs are in row order in the filling buffer.
+             */
+            std::vector<Request> pending;
+
+            /**
+             * Double-buffered network inputs: submitters write into one while the worker evaluates the other.
+             */
+            BatchBuffer inputs[2];
+            int filling{ 0 };
+            std::vector<float> batch_outputs;
+
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::condition_variable space;                          //signalled when the filling buffer is swapped out
+            bool running{ true };
+
+            /**
+             * Batching thread.
+             */
+            std::thread worker;
+
+            /**
+             * Waits for a full batch (or the flush timeout) and evaluates it until the queue is shut down.
+             */
+            void run();
+
+            /**
+             * Runs the value network on a batch of leaves and fulfils their promises.
+             * @param {std::vector<Request>&} batch - the leaves to evaluate.
+             * @param {const BatchBuffer&} batch_inputs - their network inputs.
+             */
+            void flush(std::vector<Request>& batch, const BatchBuffer& batch_inputs);
+
+        public:
+            /**
+             * @param {Backend} net_backend - the value network forward pass.
+             * @param {EvalCache*} result_cache - cache that evaluations are stored in, or nullptr.
+             * @param {size_t} width - floats per network input.
+             * @param {size_t} max_batch - maximum number of leaves per network call.
+             * @param {std::chrono::microseconds} timeout - flush timeout for partial batches.
+             */
+            EvalQueue(Backend net_backend, EvalCache* result_cache, size_t width, size_t max_batch, std::chrono::microseconds timeout);
+
+            ~EvalQueue();
+
+            /**
+             * Queues a position for evaluation. The input is copied straight into the next batch on the calling thread.
+             * Blocks while the next batch is full.
+             * @param {const float*} input - the network input of the leaf position.
+             * @param {libchess::Position::hash_type} hash - hash of the leaf position.
+             * @returns {std::future<float>} the network evaluation from the side to move's perspective.
+             */
+            std::future<float> submit(const float* input, libchess::Position::hash_type hash);
+    };
+}
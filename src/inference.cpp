@@ -0,0 +1,266 @@
+#include "inference.hpp"
+#include "serialize.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace hydra {
+    void* aligned_malloc(size_t bytes) {
+        constexpr size_t ALIGNMENT = SIMD_FLOATS * sizeof(float);
+        bytes = (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+#ifdef _WIN32
+        void* data = _aligned_malloc(bytes, ALIGNMENT);
+#else
+        void* data = std::aligned_alloc(ALIGNMENT, bytes);
+#endif
+        if (data == nullptr) throw std::bad_alloc();
+        std::memset(data, 0, bytes);
+        return data;
+    }
+
+    void aligned_free(void* data) {
+#ifdef _WIN32
+        _aligned_free(data);
+#else
+        std::free(data);
+#endif
+    }
+
+    namespace {
+        constexpr size_t BATCH_BLOCK = 4; //positions sharing each weight row load
+
+#if defined(__AVX512F__)
+        /**
+         * Dot products of one weight row with four input rows. Lengths are multiples of SIMD_FLOATS.
+         */
+        inline void dot4(const float* w, const float* x, size_t stride, size_t n, float* out) {
+            __m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps(), a2 = _mm512_setzero_ps(), a3 = _mm512_setzero_ps();
+            for (size_t i = 0; i < n; i += 16) {
+                __m512 wi = _mm512_load_ps(w + i);
+                a0 = _mm512_fmadd_ps(wi, _mm512_load_ps(x + i), a0);
+                a1 = _mm512_fmadd_ps(wi, _mm512_load_ps(x + stride + i), a1);
+                a2 = _mm512_fmadd_ps(wi, _mm512_load_ps(x + 2 * stride + i), a2);
+                a3 = _mm512_fmadd_ps(wi, _mm512_load_ps(x + 3 * stride + i), a3);
+            }
+            out[0] = _mm512_reduce_add_ps(a0);
+            out[1] = _mm512_reduce_add_ps(a1);
+            out[2] = _mm512_reduce_add_ps(a2);
+            out[3] = _mm512_reduce_add_ps(a3);
+        }
+
+        inline float dot(const float* w, const float* x, size_t n) {
+            //two accumulators hide the FMA latency
+            __m512 a0 = _mm512_setzero_ps(), a1 = _mm512_setzero_ps();
+            size_t i = 0;
+            for (; i + 32 <= n; i += 32) {
+                a0 = _mm512_fmadd_ps(_mm512_load_ps(w + i), _mm512_load_ps(x + i), a0);
+                a1 = _mm512_fmadd_ps(_mm512_load_ps(w + i + 16), _mm512_load_ps(x + i + 16), a1);
+            }
+            if (i < n) a0 = _mm512_fmadd_ps(_mm512_load_ps(w + i), _mm512_load_ps(x + i), a0);
+            return _mm512_reduce_add_ps(_mm512_add_ps(a0, a1));
+        }
+#elif defined(__AVX2__)
+        /**
+         * a * b + c. FMA is a separate instruction set from AVX2 (e.g. -mavx2 alone, or MSVC /arch:AVX2, which never
+         * defines __FMA__), so without it the product and sum are separate instructions.
+         */
+        inline __m256 fmadd(__m256 a, __m256 b, __m256 c) {
+#if defined(__FMA__)
+            return _mm256_fmadd_ps(a, b, c);
+#else
+            return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+        }
+
+        inline float hsum(__m256 v) {
+            __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+            s = _mm_add_ss(s, _mm_movehdup_ps(s));
+            return _mm_cvtss_f32(s);
+        }
+
+        inline void dot4(const float* w, const float* x, size_t stride, size_t n, float* out) {
+            __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps(), a2 = _mm256_setzero_ps(), a3 = _mm256_setzero_ps();
+            for (size_t i = 0; i < n; i += 8) {
+                __m256 wi = _mm256_load_ps(w + i);
+                a0 = fmadd(wi, _mm256_load_ps(x + i), a0);
+                a1 = fmadd(wi, _mm256_load_ps(x + stride + i), a1);
+                a2 = fmadd(wi, _mm256_load_ps(x + 2 * stride + i), a2);
+                a3 = fmadd(wi, _mm256_load_ps(x + 3 * stride + i), a3);
+            }
+            out[0] = hsum(a0);
+            out[1] = hsum(a1);
+            out[2] = hsum(a2);
+            out[3] = hsum(a3);
+        }
+
+        inline float dot(const float* w, const float* x, size_t n) {
+            //two accumulators hide the FMA latency; n is a multiple of 16
+            __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+            for (size_t i = 0; i < n; i += 16) {
+                a0 = fmadd(_mm256_load_ps(w + i), _mm256_load_ps(x + i), a0);
+                a1 = fmadd(_mm256_load_ps(w + i + 8), _mm256_load_ps(x + i + 8), a1);
+            }
+            return hsum(_mm256_add_ps(a0, a1));
+        }
+#else
+        inline void dot4(const float* w, const float* x, size_t stride, size_t n, float* out) {
+            float a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+            for (size_t i = 0; i < n; i++) {
+                a0 += w[i] * x[i];
+                a1 += w[i] * x[stride + i];
+                a2 += w[i] * x[2 * stride + i];
+                a3 += w[i] * x[3 * stride + i];
+            }
+            out[0] = a0;
+            out[1] = a1;
+            out[2] = a2;
+            out[3] = a3;
+        }
+
+        inline float dot(const float* w, const float* x, size_t n) {
+            float acc = 0;
+            for (size_t i = 0; i < n; i++) acc += w[i] * x[i];
+            return acc;
+        }
+#endif
+    }
+
+    void CPUEval::load(Eval& net) {
+        torch::NoGradGuard no_grad;
+        layers.clear();
+        for (const torch::nn::Linear& fc : { net->fc1, net->fc2, net->fc3, net->fc4 }) {
+            torch::Tensor weight = fc->weight.detach().to(at::kCPU).to(at::kFloat).contiguous();
+            torch::Tensor bias = fc->bias.detach().to(at::kCPU).to(at::kFloat).contiguous();
+            Layer layer;
+            layer.outputs = weight.size(0);
+            layer.inputs = simd_padded(weight.size(1));
+            layer.weights = make_aligned(layer.outputs * layer.inputs);
+            layer.bias = make_aligned(layer.outputs);
+            const float* src = weight.data_ptr<float>();
+            for (size_t row = 0; row < layer.outputs; row++) {
+                std::memcpy(&layer.weights[row * layer.inputs], src + row * weight.size(1), weight.size(1) * sizeof(float));
+            }
+            std::memcpy(layer.bias.get(), bias.data_ptr<float>(), layer.outputs * sizeof(float));
+            layers.push_back(std::move(layer));
+        }
+        activations.clear();
+        batch_capacity = 0;
+    }
+
+    void CPUEval::reserve(size_t batch) {
+        if (batch <= batch_capacity) return;
+        //round up to whole blocks so the blocked kernel never reads past the buffers
+        batch_capacity = (batch + BATCH_BLOCK - 1) / BATCH_BLOCK * BATCH_BLOCK;
+        activations.clear();
+        for (const Layer& layer : layers) {
+            activations.push_back(make_aligned(batch_capacity * layer.inputs));
+        }
+        activations.push_back(make_aligned(batch_capacity * layers.back().outputs));
+    }
+
+    void CPUEval::forward(const float* inputs, float* outputs, size_t batch) {
+        reserve(batch);
+
+        //copy into padded rows
+        size_t stride = layers[0].inputs;
+        for (size_t b = 0; b < batch; b++) {
+            std::memcpy(&activations[0][b * stride], inputs + b * INPUT_SIZE, INPUT_SIZE * sizeof(float));
+        }
+        run(0, outputs, batch);
+    }
+
+    void CPUEval::forward_hidden(const float* pre_activations, float* outputs, size_t batch) {
+        reserve(batch);
+
+        //first layer activation
+        size_t stride = layers[1].inputs;
+        for (size_t b = 0; b < batch; b++) {
+            float* x = &activations[1][b * stride];
+            for (size_t h = 0; h < HIDDEN_SIZE; h++) {
+                x[h] = std::max(pre_activations[b * HIDDEN_SIZE + h], 0.0f);
+            }
+        }
+        run(1, outputs, batch);
+    }
+
+    void CPUEval::run(size_t first, float* outputs, size_t batch) {
+        for (size_t l = first; l < layers.size(); l++) {
+            const Layer& layer = layers[l];
+            const float* x = activations[l].get();
+            float* y = activations[l + 1].get();
+            size_t out_stride = l + 1 < layers.size() ? layers[l + 1].inputs : layer.outputs;
+            bool last = l + 1 == layers.size();
+
+            size_t b = 0;
+            //GEMM: four positions per weight row
+            for (; b + BATCH_BLOCK <= batch; b += BATCH_BLOCK) {
+                for (size_t o = 0; o < layer.outputs; o++) {
+                    float sums[BATCH_BLOCK];
+                    dot4(&layer.weights[o * layer.inputs], x + b * layer.inputs, layer.inputs, layer.inputs, sums);
+                    for (size_t k = 0; k < BATCH_BLOCK; k++) {
+                        float v = sums[k] + layer.bias[o];
+                        y[(b + k) * out_stride + o] = last ? std::tanh(v) : std::max(v, 0.0f);
+                    }
+                }
+            }
+            //GEMV: remaining positions
+            for (; b < batch; b++) {
+                for (size_t o = 0; o < layer.outputs; o++) {
+                    float v = dot(&layer.weights[o * layer.inputs], x + b * layer.inputs, layer.inputs) + layer.bias[o];
+                    y[b * out_stride + o] = last ? std::tanh(v) : std::max(v, 0.0f);
+                }
+            }
+        }
+
+        //the network has a single output
+        const float* result = activations.back().get();
+        for (size_t b = 0; b < batch; b++) {
+            outputs[b] = result[b * layers.back().outputs];
+        }
+    }
+
+    void PolicyHead::load(Eval& net) {
+        torch::NoGradGuard no_grad;
+        torch::Tensor weight = net->policy->weight.detach().to(at::kCPU).to(at::kFloat).contiguous();
+        torch::Tensor policy_bias = net->policy->bias.detach().to(at::kCPU).to(at::kFloat).contiguous();
+        load(weight.data_ptr<float>(), policy_bias.data_ptr<float>());
+    }
+
+    void PolicyHead::load(const float* weight, const float* policy_bias) {
+        //HIDDEN_SIZE is a whole number of SIMD registers, so every row stays aligned
+        static_assert(HIDDEN_SIZE % SIMD_FLOATS == 0, "policy rows must be aligned");
+        weights = make_aligned(static_cast<size_t>(POLICY_SIZE) * HIDDEN_SIZE);
+        bias = make_aligned(POLICY_SIZE);
+        std::memcpy(weights.get(), weight, static_cast<size_t>(POLICY_SIZE) * HIDDEN_SIZE * sizeof(float));
+        std::memcpy(bias.get(), policy_bias, POLICY_SIZE * sizeof(float));
+    }
+
+    void PolicyHead::priors(const float* pre_activations, const int* moves, size_t count, float* out) const {
+        //first layer activation, kept per thread so the search threads share nothing
+        thread_local aligned_floats x = make_aligned(HIDDEN_SIZE);
+        for (size_t h = 0; h < HIDDEN_SIZE; h++) {
+            x[h] = std::max(pre_activations[h], 0.0f);
+        }
+
+        //softmax over the legal moves only
+        float max_logit = -INFINITY;
+        for (size_t i = 0; i < count; i++) {
+            out[i] = dot(&weights[static_cast<size_t>(moves[i]) * HIDDEN_SIZE], x.get(), HIDDEN_SIZE) + bias[moves[i]];
+            max_logit = std::max(max_logit, out[i]);
+        }
+        float sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            out[i] = std::exp(out[i] - max_logit);
+            sum += out[i];
+        }
+        for (size_t i = 0; i < count; i++) {
+            out[i] /= sum;
+        }
+    }
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "neural.hpp"
+
+namespace hydra {
+    /**
+     * Alignment of network buffers in floats (one AVX-512 register, 64 bytes).
+     */
+    constexpr size_t SIMD_FLOATS = 16;
+
+    /**
+     * Rounds a dimension up to a whole number of SIMD registers.
+     * @param {size_t} size - dimension.
+     * @returns {size_t} padded dimension.
+     */
+    constexpr size_t simd_padded(size_t size) {
+        return (size + SIMD_FLOATS - 1) / SIMD_FLOATS * SIMD_FLOATS;
+    }
+
+    /**
+     * Allocates zeroed memory aligned to a SIMD register.
+     * @param {size_t} bytes - size, rounded up to a whole number of registers.
+     * @returns {void*} the memory.
+     */
+    void* aligned_malloc(size_t bytes);
+
+    void aligned_free(void* data);
+
+    struct AlignedDeleter {
+        void operator()(void* data) const {
+            aligned_free(data);
+        }
+    };
+
+    /**
+     * Float array aligned to SIMD_FLOATS.
+     */
+    using aligned_floats = std::unique_ptr<float[], AlignedDeleter>;
+
+    /**
+     * Allocates a zeroed aligned float array.
+     * @param {size_t} count - number of floats, rounded up to SIMD_FLOATS.
+     * @returns {aligned_floats} the array.
+     */
+    inline aligned_floats make_aligned(size_t count) {
+        return aligned_floats(static_cast<float*>(aligned_malloc(count * sizeof(float))));
+    }
+
+    /**
+     * Forward pass of the value network on the CPU, without libtorch. The trained weights are copied into padded,
+     * aligned row-major arrays and evaluated by hand-written AVX-512/AVX2 kernels (scalar fallback otherwise), so a
+     * call does no dispatching, autograd bookkeeping or allocation.
+     */
+    class CPUEval {
+        private:
+            /**
+             * A fully connected layer. Rows are padded to a whole number of SIMD registers with zero weights.
+             */
+            struct Layer {
+                size_t inputs;                                                                  //padded input width
+                size_t outputs;
+                aligned_floats weights;                                                         //outputs x inputs
+                aligned_floats bias;
+            };
+
+            std::vector<Layer> layers;
+
+            /**
+             * Activations of the current batch, one buffer per layer input, batch_capacity rows each.
+             */
+            std::vector<aligned_floats> activations;
+            size_t batch_capacity{ 0 };
+
+            /**
+             * Grows the activation buffers to hold a batch.
+             * @param {size_t} batch - number of positions.
+             */
+            void reserve(size_t batch);
+
+            /**
+             * Runs the layers from first onwards on the activations already in place.
+             * @param {size_t} first - index of the first layer to run.
+             * @param {float*} outputs - receives one evaluation per position.
+             * @param {size_t} batch - number of positions.
+             */
+            void run(size_t first, float* outputs, size_t batch);
+
+        public:
+            /**
+             * Copies the weights of a trained network.
+             * @param {Eval&} net - the value network.
+             */
+            void load(Eval& net);
+
+            /**
+             * Evaluates a batch of positions. Not thread safe: activation buffers are shared between calls.
+             * @param {const float*} inputs - batch x INPUT_SIZE serialized positions.
+             * @param {float*} outputs - receives one evaluation per position.
+             * @param {size_t} batch - number of positions.
+             */
+            void forward(const float* inputs, float* outputs, size_t batch);
+
+            /**
+             * Evaluates a batch of positions from their first layer pre-activations (see Accumulator).
+             * @param {const float*} pre_activations - batch x HIDDEN_SIZE first layer outputs before the activation.
+             * @param {float*} outputs - receives one evaluation per position.
+             * @param {size_t} batch - number of positions.
+             */
+            void forward_hidden(const float* pre_activations, float* outputs, size_t batch);
+    };
+
+    /**
+     * Policy head of the value network on the CPU. Only the rows of the legal moves are read, one dot product each,
+     * from the first layer pre-activations the search threads already keep in their accumulators.
+     */
+    class PolicyHead {
+        private:
+            aligned_floats weights;                                                             //POLICY_SIZE x HIDDEN_SIZE
+            aligned_floats bias;
+
+        public:
+            /**
+             * Copies the policy layer of a trained network.
+             * @param {Eval&} net - the value network.
+             */
+            void load(Eval& net);
+
+            /**
+             * Copies policy weights, e.g. dequantized ones.
+             * @param {const float*} weight - POLICY_SIZE x HIDDEN_SIZE weights.
+             * @param {const float*} policy_bias - POLICY_SIZE biases.
+             */
+            void load(const float* weight, const float* policy_bias);
+
+            /**
+             * Whether weights were loaded. Without them the search uses uniform priors.
+             * @returns {bool} true once loaded.
+             */
+            bool available() const {
+                return weights != nullptr;
+            }
+
+            /**
+             * Move priors of a position: softmax of the policy logits over its legal moves. Thread safe.
+             * @param {const float*} pre_activations - HIDDEN_SIZE first layer outputs for the side to move.
+             * @param {const int*} moves - policy indices of the legal moves (see policy_index).
+             * @param {size_t} count - number of legal moves.
+             * @param {float*} out - receives one prior per move.
+             */
+            void priors(const float* pre_activations, const int* moves, size_t count, float* out) const;
+    };
+}
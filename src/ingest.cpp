@@ -0,0 +1,334 @@
+#include "ingest.hpp"
+#include "serialize.hpp"
+#include <Lookups.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace hydra {
+    namespace {
+        /**
+         * Records buffered per thread before they are written out.
+         */
+        constexpr size_t WRITE_RECORDS = 1 << 16;
+
+        /**
+         * Piece code of a FEN character.
+         * @param {char} c - FEN piece letter.
+         * @returns {int} colour * 6 + piece, or -1 if c is not a piece.
+         */
+        int piece_code(char c) {
+            switch (c) {
+                case 'P': return 0;
+                case 'N': return 1;
+                case 'B': return 2;
+                case 'R': return 3;
+                case 'Q': return 4;
+                case 'K': return 5;
+                case 'p': return 6;
+                case 'n': return 7;
+                case 'b': return 8;
+                case 'r': return 9;
+                case 'q': return 10;
+                case 'k': return 11;
+                default: return -1;
+            }
+        }
+
+        bool is_digit(char c) {
+            return c >= '0' && c <= '9';
+        }
+
+        /**
+         * Parses a decimal number without going through the locale or a stream.
+         * @param {const char*} p - first character.
+         * @param {const char*} end - end of the field. Surrounding spaces are allowed.
+         * @param {float&} out - receives the value.
+         * @returns {bool} false if the field is not a finite number.
+         */
+        bool parse_score(const char* p, const char* end, float& out) {
+            while (p < end && *p == ' ') p++;
+            while (end > p && end[-1] == ' ') end--;
+
+            bool negative = false;
+            if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+            //up to 19 significant digits are kept, the rest only scale the value
+            std::uint64_t mantissa = 0;
+            int exponent = 0;
+            int digits = 0;
+            for (; p < end && is_digit(*p); p++, digits++) {
+                if (mantissa < 1000000000000000000ull) mantissa = mantissa * 10 + (*p - '0');
+                else exponent++;
+            }
+            if (p < end && *p == '.') {
+                for (p++; p < end && is_digit(*p); p++, digits++) {
+                    if (mantissa < 1000000000000000000ull) {
+                        mantissa = mantissa * 10 + (*p - '0');
+                        exponent--;
+                    }
+                }
+            }
+            if (digits == 0) return false;
+
+            if (p < end && (*p == 'e' || *p == 'E')) {
+                p++;
+                bool negative_exponent = false;
+                if (p < end && (*p == '-' || *p == '+')) negative_exponent = *p++ == '-';
+                int value = 0;
+                int exponent_digits = 0;
+                for (; p < end && is_digit(*p); p++, exponent_digits++) {
+                    if (value < 10000) value = value * 10 + (*p - '0');
+                }
+                if (exponent_digits == 0) return false;
+                exponent += negative_exponent ? -value : value;
+            }
+            if (p != end) return false;
+
+            double value = static_cast<double>(mantissa);
+            value = exponent < 0 ? value / std::pow(10.0, -exponent) : value * std::pow(10.0, exponent);
+            out = static_cast<float>(negative ? -value : value);
+            return std::isfinite(out);
+        }
+
+        /**
+         * Checks whether a king is attacked.
+         * @param {const std::uint64_t*} pieces - occupancy per piece code.
+         * @param {int} color - colour of the king, 0 for white, 1 for black.
+         * @returns {bool} true if the other side attacks the king.
+         */
+        bool in_check(const std::uint64_t* pieces, int color) {
+            using namespace libchess;
+            const std::uint64_t* attacker = pieces + (color ^ 1) * 6;
+            std::uint64_t occupancy = 0;
+            for (int code = 0; code < 12; code++) occupancy |= pieces[code];
+            Square king = Bitboard{ pieces[color * 6 + 5] }.forward_bitscan();
+
+            std::uint64_t attacks = lookups::pawn_attacks(king, color == 0 ? constants::WHITE : constants::BLACK) & Bitboard{ attacker[0] };
+            attacks |= lookups::knight_attacks(king) & Bitboard{ attacker[1] };
+            attacks |= lookups::bishop_attacks(king, Bitboard{ occupancy }) & Bitboard{ attacker[2] | attacker[4] };
+            attacks |= lookups::rook_attacks(king, Bitboard{ occupancy }) & Bitboard{ attacker[3] | attacker[4] };
+            attacks |= lookups::king_attacks(king) & Bitboard{ attacker[5] };
+            return attacks != 0;
+        }
+
+        /**
+         * Parses the lines of a byte range and writes the valid ones to a packed file.
+         * @param {const char*} begin - start of the range, at the start of a line.
+         * @param {const char*} end - end of the range, just past a line break or at the end of the input.
+         * @param {const std::string&} path - destination file.
+         * @param {size_t&} lines - receives the number of non-empty lines.
+         * @param {size_t&} packed - receives the number of records written.
+         * @returns {bool} true if the file was written.
+         */
+        bool pack_range(const char* begin, const char* end, const std::string& path, size_t& lines, size_t& packed) {
+            std::ofstream out(path, std::ios::binary);
+            if (!out) return false;
+            //header is rewritten with the final count at the end
+            write_packed_header(out, 0);
+
+            std::vector<PackedPosition> records;
+            records.reserve(WRITE_RECORDS);
+            auto write_records = [&]() {
+                out.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(PackedPosition));
+                packed += records.size();
+                records.clear();
+            };
+
+            for (const char* line = begin; line < end;) {
+                const char* line_break = static_cast<const char*>(std::memchr(line, '\n', end - line));
+                if (line_break == nullptr) line_break = end;
+                const char* line_end = line_break > line && line_break[-1] == '\r' ? line_break - 1 : line_break;
+                if (line_end > line) {
+                    lines++;
+                    PackedPosition record;
+                    if (parse_packed_line(line, line_end, record)) {
+                        records.push_back(record);
+                        if (records.size() == WRITE_RECORDS) write_records();
+                    }
+                }
+                line = line_break + 1;
+            }
+            write_records();
+
+            out.seekp(0);
+            write_packed_header(out, packed);
+            return static_cast<bool>(out);
+        }
+    }
+
+    bool parse_packed_line(const char* begin, const char* end, PackedPosition& out) {
+        const char* comma = std::find(begin, end, ',');
+        if (comma == end) return false;
+        const char* p = begin;
+
+        //piece placement, rank 8 first
+        std::int8_t board[64];
+        std::fill(board, board + 64, -1);
+        std::uint64_t pieces[12] = {};
+        int rank = 7;
+        int file = 0;
+        for (; p < comma && *p != ' '; p++) {
+            if (*p == '/') {
+                if (file != 8 || rank == 0) return false;
+                rank--;
+                file = 0;
+            }
+            else if (*p >= '1' && *p <= '8') {
+                file += *p - '0';
+                if (file > 8) return false;
+            }
+            else {
+                int code = piece_code(*p);
+                if (code < 0 || file == 8) return false;
+                board[rank * 8 + file] = static_cast<std::int8_t>(code);
+                pieces[code] |= std::uint64_t(1) << (rank * 8 + file);
+                file++;
+            }
+        }
+        if (rank != 0 || file != 8) return false;
+
+        //side to move
+        while (p < comma && *p == ' ') p++;
+        if (p == comma || (*p != 'w' && *p != 'b')) return false;
+        int side = *p++ == 'b' ? 1 : 0;
+        if (p == comma || *p != ' ') return false;
+
+        //castling rights
+        while (p < comma && *p == ' ') p++;
+        int rights = 0;
+        if (p < comma && *p == '-') p++;
+        else {
+            for (; p < comma && *p != ' '; p++) {
+                switch (*p) {
+                    case 'K': rights |= 1; break;
+                    case 'Q': rights |= 2; break;
+                    case 'k': rights |= 4; break;
+                    case 'q': rights |= 8; break;
+                    default: return false;
+                }
+            }
+        }
+        //the remaining fields (en passant square, move counters) are not network inputs
+        if (p < comma && *p != ' ') return false;
+
+        //legality
+        constexpr std::uint64_t BACK_RANKS = 0xFF000000000000FFull;
+        if (libchess::Bitboard{ pieces[5] }.popcount() != 1 || libchess::Bitboard{ pieces[11] }.popcount() != 1) return false;
+        if ((pieces[0] | pieces[6]) & BACK_RANKS) return false;
+        for (int color = 0; color < 2; color++) {
+            int count = 0;
+            for (int piece = 0; piece < 6; piece++) count += libchess::Bitboard{ pieces[color * 6 + piece] }.popcount();
+            if (count > 16) return false;
+        }
+        if ((rights & 3) && board[4] != 5) return false;
+        if ((rights & 12) && board[60] != 11) return false;
+        if (((rights & 1) && board[7] != 3) || ((rights & 2) && board[0] != 3)) return false;
+        if (((rights & 4) && board[63] != 9) || ((rights & 8) && board[56] != 9)) return false;
+        if (in_check(pieces, side ^ 1)) return false;
+
+        const char* score_end = std::find(comma + 1, end, ',');
+        float score;
+        if (!parse_score(comma + 1, score_end, score)) return false;
+
+        //optional best move label
+        int best_move = -1;
+        if (score_end != end) {
+            const char* move = score_end + 1;
+            const char* move_end = std::find(move, end, ',');
+            while (move < move_end && *move == ' ') move++;
+            while (move_end > move && move_end[-1] == ' ') move_end--;
+            if (move != move_end) {
+                best_move = parse_move_index(move, move_end);
+                if (best_move < 0 || board[best_move / 64] < 0 || board[best_move / 64] / 6 != side) return false;
+            }
+        }
+        return pack_board(board, side, rights, score, out, best_move);
+    }
+
+    bool convert_to_packed(const std::string& csv_path, const std::string& packed_path, int threads) {
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<MappedFile> csv;
+        try {
+            csv = std::make_unique<MappedFile>(csv_path);
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+        if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+        //a trailing separator asks for a shard directory that may not exist yet
+        bool sharded = std::filesystem::is_directory(packed_path) ||
+                       (!packed_path.empty() && (packed_path.back() == '/' || packed_path.back() == '\\'));
+        std::error_code error;
+        if (sharded && !std::filesystem::create_directories(packed_path, error) && error) return false;
+
+        //ranges start just past the first line break at or after their nominal offset, so each line has one owner
+        const char* data = static_cast<const char*>(csv->data());
+        size_t size = csv->size();
+        std::vector<size_t> bounds(threads + 1, size);
+        bounds[0] = 0;
+        for (int i = 1; i < threads; i++) {
+            size_t offset = size / threads * i;
+            const void* line_break = offset == 0 ? nullptr : std::memchr(data + offset - 1, '\n', size - offset + 1);
+            bounds[i] = offset == 0 ? 0 : line_break == nullptr ? size : static_cast<const char*>(line_break) - data + 1;
+        }
+
+        std::vector<std::string> shards(threads);
+        for (int i = 0; i < threads; i++) {
+            char name[32];
+            std::snprintf(name, sizeof(name), sharded ? "shard-%04d.bin" : ".part%d", i);
+            shards[i] = sharded ? (std::filesystem::path(packed_path) / name).string() : packed_path + name;
+        }
+
+        std::vector<size_t> lines(threads, 0);
+        std::vector<size_t> packed(threads, 0);
+        std::atomic<bool> failed{ false };
+        std::vector<std::thread> workers;
+        for (int i = 0; i < threads; i++) {
+            workers.emplace_back([&, i]() {
+                if (!pack_range(data + bounds[i], data + bounds[i + 1], shards[i], lines[i], packed[i])) failed = true;
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        size_t line_count = 0;
+        size_t packed_count = 0;
+        for (int i = 0; i < threads; i++) {
+            line_count += lines[i];
+            packed_count += packed[i];
+        }
+
+        //single file output: append the shards in input order
+        if (!sharded) {
+            std::ofstream out(packed_path, std::ios::binary);
+            write_packed_header(out, packed_count);
+            for (const std::string& shard : shards) {
+                std::ifstream in(shard, std::ios::binary);
+                size_t count;
+                if (!read_packed_header(in, count)) failed = true;
+                else if (count > 0) out << in.rdbuf();
+                in.close();
+                std::filesystem::remove(shard, error);
+            }
+            if (!out) failed = true;
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Packed " << packed_count << " positions (" << line_count - packed_count << " skipped) from "
+                  << line_count << " lines in " << seconds << "s on " << threads << " threads ("
+                  << static_cast<size_t>(line_count / std::max(seconds, 1e-6)) << " lines/s).\n";
+        return !failed;
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include "packed.hpp"
+
+namespace hydra {
+    /**
+     * Parses and packs one dataset line (fen,evaluation[,best move in UCI notation]). Hand written and allocation free so that many threads can
+     * parse at once. Positions that cannot occur in a game are rejected: a king count other than one per side, more
+     * than 16 pieces per side, pawns on the back ranks, castling rights without the king and rook on their squares,
+     * or the side not to move in check. A best move must start on a square holding a piece of the side to move.
+     * @param {const char*} begin - first character of the line.
+     * @param {const char*} end - end of the line, excluding the line break.
+     * @param {PackedPosition&} out - receives the record.
+     * @returns {bool} false if the line is not a valid example.
+     */
+    bool parse_packed_line(const char* begin, const char* end, PackedPosition& out);
+
+    /**
+     * Converts a CSV dataset into packed form on several threads. The input is memory mapped and split into byte
+     * ranges on line boundaries, and each thread parses its range into its own shard. If the destination is a
+     * directory (or ends with a path separator) the shards are kept there, ready to be streamed by -train; otherwise
+     * they are concatenated into a single packed file in input order. Invalid lines are skipped.
+     * @param {const std::string&} csv_path - source dataset.
+     * @param {const std::string&} packed_path - destination file or directory.
+     * @param {int} threads - number of threads, 0 for one per core.
+     * @returns {bool} true on success.
+     */
+    bool convert_to_packed(const std::string& csv_path, const std::string& packed_path, int threads = 0);
+}
@@ -3,6 +3,9 @@
 #include "neural.hpp"
 #include "serialize.hpp"
 #include "train.hpp"
+#include "quantize.hpp"
+#include "ingest.hpp"
+#include "timeman.hpp"
 #include <UCIService.h>
 
 using namespace hydra;
@@ -10,22 +13,42 @@ using namespace hydra;
 libchess::Position global_pos{ libchess::constants::STARTPOS_FEN };
 libchess::UCIService uci(config::ENGINE_NAME, config::ENGINE_AUTHOR);
 MCTSearch mcts;
+TimeManager time_manager;
 
-bool stopped = false;
+std::atomic<bool> stopped{ false };
 
 /**
  * Handle GO events by the UCI service.
  */
 void handle_go(const libchess::UCIGoParameters& params) {
     stopped = false;
+    time_manager.start(params, global_pos.side_to_move());
     int predicted_score{0};
-    libchess::Move chosen_move = mcts.choose_best_move(global_pos, stopped, predicted_score);
+    libchess::Move chosen_move = mcts.choose_best_move(global_pos, stopped, time_manager, predicted_score);
 
     //send info to gui
+    double seconds = time_manager.elapsed(TimeManager::clock::now());
     libchess::UCIInfoParameters info_params;
     info_params.set_score(libchess::UCIScore{ predicted_score, libchess::UCIScore::ScoreType::CENTIPAWNS });
+    const SearchSummary& summary = mcts.last_search();
+    info_params.set_nodes(summary.playouts);
+    info_params.set_time(static_cast<int>(seconds * 1000));
+    info_params.set_nps(static_cast<std::uint64_t>(summary.playouts / std::max(seconds, 1e-3)));
+    info_params.set_hashfull(summary.hashfull);
+    const EvalCache& cache = mcts.evaluation_cache();
+    std::uint64_t probes = std::max<std::uint64_t>(cache.probe_count(), 1);
+    info_params.set_string("evalcache hits " + std::to_string(cache.hit_count()) + "/" + std::to_string(cache.probe_count()) +
+                           " (" + std::to_string(cache.hit_count() * 100 / probes) + "%)" +
+                           " stop " + SearchSummary::name(summary.reason) +
+                           " saved " + std::to_string(static_cast<long long>(summary.saved_playouts)) + " playouts " +
+                           std::to_string(static_cast<int>(summary.saved_seconds * 1000)) + " ms");
     uci.info(info_params);
-    uci.bestmove(chosen_move.to_str());
+    if (summary.ponder_move.has_value()) {
+        uci.bestmove(chosen_move.to_str(), summary.ponder_move->to_str());
+    }
+    else {
+        uci.bestmove(chosen_move.to_str());
+    }
 }
 
 /**
@@ -35,6 +58,14 @@ void handle_stop() {
     stopped = true;
 }
 
+/**
+ * Handle PONDERHIT events by the UCI service. The opponent played the move being pondered on, so the running search
+ * continues on the accumulated tree with the time limits of its go command.
+ */
+void handle_ponderhit(std::istringstream&) {
+    time_manager.ponderhit();
+}
+
 /**
  * Handles POSITION events by the UCI service. If the opponents chosen move is in the search tree (which is very likely, especially as the game goes on),
  * it will transfer down the search tree to that node. Otherwise, it will create a new search tree.
@@ -56,9 +87,33 @@ void handle_position(const libchess::UCIPositionParameters& params) {
 int main(int argc, char* argv[]) {
     if (argc > 2 && strcmp(argv[1], "-train") == 0) {
         Eval evaluator;
-        train(evaluator, argv[2]);
+        train(evaluator, argv[2], argc > 3 ? argv[3] : "");
     } 
+    else if (argc > 3 && strcmp(argv[1], "-pack") == 0) {
+        if (!convert_to_packed(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 0)) std::cout << "Could not convert " << argv[2] << "\n";
+    }
+    else if (argc > 2 && strcmp(argv[1], "-quantize") == 0) {
+        Eval evaluator;
+        quantize(evaluator, argv[2]);
+    }
     else {
+        uci.register_option(libchess::UCISpinOption{ "Hash", config::HASH_MB, 16, 65536, [](const int& megabytes) {
+            mcts.set_hash_size(megabytes);
+        }});
+        uci.register_option(libchess::UCICheckOption{ "Transpositions", config::TRANSPOSITIONS, [](const bool& use) {
+            mcts.set_use_transpositions(use);
+        }});
+        uci.register_option(libchess::UCIComboOption{ "TreeFull", "stop", { "stop", "prune" }, [](const std::string& action) {
+            mcts.set_prune_full_tree(action == "prune");
+        }});
+        uci.register_option(libchess::UCISpinOption{ "MoveOverhead", config::MOVE_OVERHEAD, 0, 5000, [](const int& milliseconds) {
+            time_manager.set_move_overhead(milliseconds);
+        }});
+        uci.register_option(libchess::UCICheckOption{ "Ponder", false, [](const bool&) {} });
+        uci.register_handler("ponderhit", handle_ponderhit);
+        uci.register_handler("ucinewgame", [](std::istringstream&) {
+            mcts.clear_eval_cache();
+        });
         uci.register_position_handler(handle_position);
         uci.register_go_handler(handle_go);
         uci.register_stop_handler(handle_stop);
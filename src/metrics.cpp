@@ -0,0 +1,118 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <cstdio>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace hydra {
+    namespace {
+        constexpr const char* PHASE_NAMES[TrainingMetrics::PHASES] = { "loader", "forward", "backward", "step" };
+
+        double elapsed(std::chrono::steady_clock::time_point since) {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+        }
+    }
+
+    size_t peak_memory() {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+        return counters.PeakWorkingSetSize;
+#else
+        rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+        return static_cast<size_t>(usage.ru_maxrss);
+#else
+        //kilobytes on Linux
+        return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+    }
+
+    TrainingMetrics::TrainingMetrics(const std::string& path, size_t dataset_size, int batch_size, int workers, const std::string& device)
+        : log(path, std::ios::app) {
+        log << "{\"type\":\"run\",\"dataset_size\":" << dataset_size << ",\"batch_size\":" << batch_size
+            << ",\"workers\":" << workers << ",\"device\":\"" << device << "\"}\n";
+        log.flush();
+        start_epoch();
+    }
+
+    void TrainingMetrics::start_epoch() {
+        mark = clock::now();
+        epoch_totals = Totals{};
+        epoch_totals.start = mark;
+        rolling = Totals{};
+        rolling.start = mark;
+    }
+
+    void TrainingMetrics::lap(Phase phase) {
+        clock::time_point now = clock::now();
+        double seconds = std::chrono::duration<double>(now - mark).count();
+        rolling.seconds[phase] += seconds;
+        epoch_totals.seconds[phase] += seconds;
+        mark = now;
+    }
+
+    void TrainingMetrics::end_batch(size_t samples, float loss) {
+        for (Totals* totals : { &rolling, &epoch_totals }) {
+            totals->samples += samples;
+            totals->batches++;
+            totals->loss += loss;
+        }
+    }
+
+    void TrainingMetrics::write(const char* type, int epoch, const Totals& totals) {
+        double wall = elapsed(totals.start);
+        char line[512];
+        int length = std::snprintf(line, sizeof(line),
+            "{\"type\":\"%s\",\"epoch\":%d,\"batches\":%zu,\"samples\":%zu,\"seconds\":%.3f,\"samples_per_sec\":%.1f,\"loss\":%.6f",
+            type, epoch, totals.batches, totals.samples, wall, totals.samples / std::max(wall, 1e-9),
+            totals.loss / std::max<size_t>(totals.batches, 1));
+        for (int phase = 0; phase < PHASES; phase++) {
+            length += std::snprintf(line + length, sizeof(line) - length, ",\"%s_sec\":%.3f", PHASE_NAMES[phase], totals.seconds[phase]);
+        }
+        std::snprintf(line + length, sizeof(line) - length, ",\"peak_memory_mb\":%.1f}\n", peak_memory() / (1024.0 * 1024.0));
+        log << line;
+        log.flush();
+    }
+
+    void TrainingMetrics::write_interval(int epoch) {
+        write("interval", epoch, rolling);
+        rolling = Totals{};
+        rolling.start = clock::now();
+    }
+
+    void TrainingMetrics::end_epoch(int epoch) {
+        write("epoch", epoch, epoch_totals);
+    }
+
+    void TrainingMetrics::write_validation(int epoch, double loss, double policy_loss, size_t samples, double seconds) {
+        char line[256];
+        std::snprintf(line, sizeof(line),
+            "{\"type\":\"validation\",\"epoch\":%d,\"samples\":%zu,\"seconds\":%.3f,\"samples_per_sec\":%.1f,\"loss\":%.6f,\"policy_loss\":%.6f}\n",
+            epoch, samples, seconds, samples / std::max(seconds, 1e-9), loss, policy_loss);
+        log << line;
+        log.flush();
+
+        auto excluded = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(seconds));
+        mark += excluded;
+        rolling.start += excluded;
+        epoch_totals.start += excluded;
+    }
+
+    double TrainingMetrics::samples_per_second() const {
+        return rolling.samples / std::max(elapsed(rolling.start), 1e-9);
+    }
+
+    double TrainingMetrics::loader_fraction() const {
+        double total = 0;
+        for (double seconds : rolling.seconds) total += seconds;
+        return total > 0 ? rolling.seconds[LOADER] / total : 0;
+    }
+}
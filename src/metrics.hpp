@@ -0,0 +1,118 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <string>
+
+namespace hydra {
+    /**
+     * Peak resident memory of the process so far.
+     * @returns {size_t} bytes, or 0 if the platform does not report it.
+     */
+    size_t peak_memory();
+
+    /**
+     * Throughput counters for the training loop. Batch time is split into phases. Every log interval a rolling record
+     * is appended to a JSONL file, and every epoch a summary record, so a run shows whether it is waiting on the data
+     * loader or on the network.
+     */
+    class TrainingMetrics {
+        public:
+            /**
+             * Phases of a training step, in order.
+             */
+            enum Phase { LOADER, FORWARD, BACKWARD, STEP, PHASES };
+
+        private:
+            using clock = std::chrono::steady_clock;
+
+            struct Totals {
+                double seconds[PHASES]{};   //time per phase
+                size_t samples{ 0 };        //examples seen
+                size_t batches{ 0 };        //batches seen
+                double loss{ 0 };           //sum of batch losses
+                clock::time_point start;    //wall clock start
+            };
+
+            std::ofstream log;
+            Totals rolling;
+            Totals epoch_totals;
+
+            /**
+             * End of the previous phase.
+             */
+            clock::time_point mark;
+
+            /**
+             * Appends one record.
+             * @param {const char*} type - record type ("interval" or "epoch").
+             * @param {int} epoch - current epoch.
+             * @param {const Totals&} totals - counters covered by the record.
+             */
+            void write(const char* type, int epoch, const Totals& totals);
+
+        public:
+            /**
+             * Opens the log (appending) and records the run settings.
+             * @param {const std::string&} path - JSONL file.
+             * @param {size_t} dataset_size - examples per epoch.
+             * @param {int} batch_size - examples per batch.
+             * @param {int} workers - data loader threads.
+             * @param {const std::string&} device - training device.
+             */
+            TrainingMetrics(const std::string& path, size_t dataset_size, int batch_size, int workers, const std::string& device);
+
+            /**
+             * Resets the epoch counters. The loader phase of the first batch starts here.
+             */
+            void start_epoch();
+
+            /**
+             * Charges the time since the end of the previous phase to a phase.
+             * @param {Phase} phase - the phase that just ended.
+             */
+            void lap(Phase phase);
+
+            /**
+             * Counts a finished batch.
+             * @param {size_t} samples - examples in the batch.
+             * @param {float} loss - batch loss.
+             */
+            void end_batch(size_t samples, float loss);
+
+            /**
+             * Writes a rolling record covering the batches since the previous one.
+             * @param {int} epoch - current epoch.
+             */
+            void write_interval(int epoch);
+
+            /**
+             * Writes the epoch summary.
+             * @param {int} epoch - the finished epoch.
+             */
+            void end_epoch(int epoch);
+
+            /**
+             * Writes a validation record. The time spent validating is left out of the training throughput.
+             * @param {int} epoch - current epoch.
+             * @param {double} loss - validation value loss.
+             * @param {double} policy_loss - validation policy cross entropy per labelled example.
+             * @param {size_t} samples - validation examples.
+             * @param {double} seconds - duration of the validation pass.
+             */
+            void write_validation(int epoch, double loss, double policy_loss, size_t samples, double seconds);
+
+            /**
+             * Throughput since the last rolling record.
+             * @returns {double} examples per second.
+             */
+            double samples_per_second() const;
+
+            /**
+             * Share of time since the last rolling record spent waiting for batches.
+             * @returns {double} fraction in [0, 1].
+             */
+            double loader_fraction() const;
+    };
+}
@@ -24,4 +24,5 @@ with open('D:\\chess-data\\pgn\\master.csv', 'w', newline='') as out:
         if FEN.split(' ')[1] == 'b': # flip for black
             score *= -1
 
+        # the scores carry no best move, so these positions only train the value (see pgn-to-csv.py for policy labels)
         outwriter.writerow([FEN, score])
@@ -41,7 +41,10 @@ class PgnToCsv:
                     if board.turn == chess.BLACK:
                         value *= -1
                     value = self.normalize_cp(value)
-                    outwriter.writerow([fen, value])
+                    # best move of the engine's principal variation (trains the policy head), empty when the game is over
+                    pv = info.get('pv')
+                    move = pv[0].uci() if pv else ''
+                    outwriter.writerow([fen, value, move])
 
         engine.quit()
 
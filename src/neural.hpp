@@ -4,19 +4,28 @@
 #include "config.hpp"
 
 namespace hydra {
+    /**
+     * Width of the hidden layers.
+     */
+    constexpr int HIDDEN_SIZE = 2048;
+
     /**
      * The actual value network. Takes in a 12x64+4 board state as input
      * and returns a single scalar from [-1, 1] as the predicted score.
+     * A policy head reads the activations of the first layer and scores every move by its origin and destination
+     * squares, so the search can compute move priors from its incremental accumulators without a network call.
+     * The head is only used by the search once training has seen positions labelled with a best move.
      */ 
     struct EvalImpl : public torch::nn::Module {
         EvalImpl()
-            : fc1(12 * 64 + 4, 2048),
+            : fc1(12 * 64 + 4, HIDDEN_SIZE),
               drop1(torch::nn::DropoutOptions().p(0.2)),
-              fc2(2048, 2048),
+              fc2(HIDDEN_SIZE, HIDDEN_SIZE),
               drop2(torch::nn::DropoutOptions().p(0.2)),
-              fc3(2048, 2048),
+              fc3(HIDDEN_SIZE, HIDDEN_SIZE),
               drop3(torch::nn::DropoutOptions().p(0.2)),
-              fc4(2048, 1)
+              fc4(HIDDEN_SIZE, 1),
+              policy(HIDDEN_SIZE, 64 * 64)
         {
             register_module("fc1", fc1);
             register_module("drop1", drop1);
@@ -25,17 +34,71 @@ namespace hydra {
             register_module("fc3", fc3);
             register_module("drop3", drop3);
             register_module("fc4", fc4);
+            register_module("policy", policy);
+            policy_trained = register_buffer("policy_trained", torch::zeros({ 1 }));
         }
 
         torch::Tensor forward(torch::Tensor x) {
-            x = drop1(torch::relu(fc1(x)));
+            return forward_hidden(fc1(x));
+        }
+
+        /**
+         * Runs the network on sparse inputs (see serialize_sparse). The first layer is an embedding bag: the sum of
+         * the weight columns of the active features.
+         * @param {torch::Tensor} indices - active feature indices of all positions, concatenated (int64).
+         * @param {torch::Tensor} offsets - index of each position's first feature in indices.
+         */
+        torch::Tensor forward_sparse(torch::Tensor indices, torch::Tensor offsets) {
+            return forward_hidden(first_layer_sparse(indices, offsets));
+        }
+
+        /**
+         * Runs the network on a batch of sparse inputs padded to a fixed length with -1.
+         * @param {torch::Tensor} features - batch x MAX_ACTIVE_FEATURES feature indices (int64).
+         */
+        torch::Tensor forward_padded(torch::Tensor features) {
+            return forward_hidden(first_layer_padded(features));
+        }
+
+        /**
+         * First layer pre-activations of sparse inputs (see forward_sparse).
+         */
+        torch::Tensor first_layer_sparse(torch::Tensor indices, torch::Tensor offsets) {
+            auto bags = torch::embedding_bag(fc1->weight.t(), indices, offsets);
+            return std::get<0>(bags) + fc1->bias;
+        }
+
+        /**
+         * First layer pre-activations of padded sparse inputs (see forward_padded).
+         */
+        torch::Tensor first_layer_padded(torch::Tensor features) {
+            torch::Tensor active = features >= 0;
+            torch::Tensor counts = active.sum(1);
+            torch::Tensor offsets = counts.cumsum(0) - counts;
+            return first_layer_sparse(features.masked_select(active), offsets);
+        }
+
+        /**
+         * Runs the policy head from the first layer's pre-activations.
+         * @returns {torch::Tensor} batch x 64*64 move logits from the side to move's point of view (see policy_index).
+         */
+        torch::Tensor forward_policy(torch::Tensor x) {
+            return policy(torch::relu(x));
+        }
+
+        /**
+         * Runs the network from the first layer's pre-activations, e.g. those kept by an Accumulator.
+         */
+        torch::Tensor forward_hidden(torch::Tensor x) {
+            x = drop1(torch::relu(x));
             x = drop2(torch::relu(fc2(x)));
             x = drop3(torch::relu(fc3(x)));
             x = torch::tanh(fc4(x));
             return x;
         }
         
-        torch::nn::Linear fc1, fc2, fc3, fc4;
+        torch::nn::Linear fc1, fc2, fc3, fc4, policy;
+        torch::Tensor policy_trained;                               //1 once the policy head trained on labelled positions
         torch::nn::Dropout drop1, drop2, drop3;
     };
     TORCH_MODULE(Eval);
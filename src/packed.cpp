@@ -0,0 +1,168 @@
+#include "packed.hpp"
+#include "serialize.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace hydra {
+    namespace {
+        constexpr char PACKED_MAGIC[8] = { 'H', 'Y', 'D', 'R', 'A', 'P', 'K', '1' };
+    }
+
+    bool pack_board(const std::int8_t* board, int perspective, int rights, float score, PackedPosition& out, int best_move) {
+        std::memset(&out, 0, sizeof(out));
+        out.score = score;
+        if (best_move >= 0) out.best_move = static_cast<std::uint16_t>(policy_index(perspective, best_move / 64, best_move % 64));
+
+        //piece code per square, from the side to move's point of view
+        std::uint8_t codes[64];
+        for (int square = 0; square < 64; square++) {
+            if (board[square] < 0) continue;
+            int feature = piece_feature(perspective, board[square] / 6, board[square] % 6, square);
+            out.occupancy |= std::uint64_t(1) << (feature & 63);
+            codes[feature & 63] = static_cast<std::uint8_t>(feature >> 6);
+        }
+        int count = 0;
+        for (std::uint64_t bb = out.occupancy; bb; bb &= bb - 1, count++) {
+            if (count == 32) return false;
+            out.pieces[count >> 1] |= codes[libchess::Bitboard(bb).forward_bitscan().value()] << ((count & 1) * 4);
+        }
+
+        for (int right = 0; right < 4; right++) {
+            if (rights & (1 << right)) out.castling |= 1 << (castling_feature(perspective, right) - 12 * 64);
+        }
+        return true;
+    }
+
+    bool pack(const libchess::Position& pos, float score, PackedPosition& out, int best_move) {
+        std::int8_t board[64];
+        std::fill(board, board + 64, -1);
+        for (libchess::Color color = libchess::constants::WHITE; color <= libchess::constants::BLACK; color++) {
+            for (libchess::PieceType piece = libchess::constants::PAWN; piece <= libchess::constants::KING; piece++) {
+                for (libchess::Bitboard bb = pos.piece_type_bb(piece, color); bb; bb.forward_popbit()) {
+                    board[bb.forward_bitscan().value()] = static_cast<std::int8_t>(color.value() * 6 + piece.value());
+                }
+            }
+        }
+        int perspective = pos.side_to_move() == libchess::constants::BLACK ? 1 : 0;
+        return pack_board(board, perspective, pos.castling_rights().value(), score, out, best_move);
+    }
+
+    int unpack_sparse(const PackedPosition& record, std::int16_t* out) {
+        int count = 0;
+        for (libchess::Bitboard bb{ record.occupancy }; bb; bb.forward_popbit(), count++) {
+            int code = (record.pieces[count >> 1] >> ((count & 1) * 4)) & 15;
+            out[count] = static_cast<std::int16_t>(code * 64 + bb.forward_bitscan().value());
+        }
+        for (int right = 0; right < 4; right++) {
+            if (record.castling & (1 << right)) out[count++] = static_cast<std::int16_t>(12 * 64 + right);
+        }
+        return count;
+    }
+
+    void unpack(const PackedPosition& record, float* out) {
+        std::fill(out, out + INPUT_SIZE, 0.0f);
+        std::int16_t features[MAX_ACTIVE_FEATURES];
+        int count = unpack_sparse(record, features);
+        for (int i = 0; i < count; i++) {
+            out[features[i]] = 1;
+        }
+    }
+
+    void write_packed_header(std::ostream& out, size_t count) {
+        PackedHeader header{};
+        std::memcpy(header.magic, PACKED_MAGIC, sizeof(header.magic));
+        header.count = count;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+
+    bool read_packed_header(std::istream& in, size_t& count) {
+        PackedHeader header;
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, PACKED_MAGIC, sizeof(PACKED_MAGIC)) != 0) {
+            return false;
+        }
+        count = header.count;
+        return true;
+    }
+
+    const PackedPosition* packed_records(const MappedFile& file, size_t& count) {
+        const PackedHeader* header = static_cast<const PackedHeader*>(file.data());
+        if (file.size() < sizeof(PackedHeader) || std::memcmp(header->magic, PACKED_MAGIC, sizeof(PACKED_MAGIC)) != 0 ||
+            (file.size() - sizeof(PackedHeader)) / sizeof(PackedPosition) < header->count) {
+            throw std::runtime_error("not a packed dataset");
+        }
+        count = header->count;
+        return reinterpret_cast<const PackedPosition*>(header + 1);
+    }
+
+    MappedFile::MappedFile(const std::string& path) {
+#ifdef _WIN32
+        file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+        if (file_handle == INVALID_HANDLE_VALUE) {
+            file_handle = nullptr;
+            throw std::runtime_error("cannot open " + path);
+        }
+        LARGE_INTEGER file_size;
+        GetFileSizeEx(file_handle, &file_size);
+        size_ = static_cast<size_t>(file_size.QuadPart);
+        mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        data_ = mapping_handle ? MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (data_ == nullptr) {
+            close();
+            throw std::runtime_error("cannot map " + path);
+        }
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("cannot open " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("cannot stat " + path);
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        void* mapping = size_ > 0 ? mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (mapping == MAP_FAILED) throw std::runtime_error("cannot map " + path);
+        //samples are drawn in random order
+        madvise(mapping, size_, MADV_RANDOM);
+        data_ = mapping;
+#endif
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept : data_(other.data_), size_(other.size_) {
+#ifdef _WIN32
+        file_handle = other.file_handle;
+        mapping_handle = other.mapping_handle;
+        other.file_handle = nullptr;
+        other.mapping_handle = nullptr;
+#endif
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+    void MappedFile::close() {
+#ifdef _WIN32
+        if (data_ != nullptr) UnmapViewOfFile(data_);
+        if (mapping_handle != nullptr) CloseHandle(mapping_handle);
+        if (file_handle != nullptr) CloseHandle(file_handle);
+        file_handle = nullptr;
+        mapping_handle = nullptr;
+#else
+        if (data_ != nullptr) munmap(const_cast<void*>(data_), size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <Position.h>
+
+namespace hydra {
+    /**
+     * A training example packed into 32 bytes. The board is stored from the side to move's point of view (as the
+     * network sees it), so decoding needs no position: colour 0 is the side to move.
+     */
+    struct PackedPosition {
+        std::uint64_t occupancy;                                                                //occupied squares
+        std::uint8_t pieces[16];                                                                //colour * 6 + piece per occupied square (ascending), one nibble each
+        std::uint8_t castling;                                                                  //castling_feature bits
+        std::uint8_t reserved;
+        std::uint16_t best_move;                                                                //policy index for the side to move, 0 if unlabelled
+        float score;                                                                            //evaluation for the side to move
+    };
+    static_assert(sizeof(PackedPosition) == 32, "packed records must stay 32 bytes");
+
+    /**
+     * First record of a packed file.
+     */
+    struct PackedHeader {
+        char magic[8];                                                                          //"HYDRAPK1"
+        std::uint64_t count;                                                                    //number of records
+        std::uint8_t reserved[16];
+    };
+    static_assert(sizeof(PackedHeader) == sizeof(PackedPosition), "the header occupies one record");
+
+    /**
+     * Packs a board given square by square.
+     * @param {const std::int8_t*} board - colour * 6 + piece on each of the 64 squares (white's point of view), -1 if empty.
+     * @param {int} perspective - side to move, 0 for white, 1 for black.
+     * @param {int} rights - castling rights (libchess bits: white kingside, white queenside, black kingside, black queenside).
+     * @param {float} score - evaluation for the side to move.
+     * @param {PackedPosition&} out - receives the record.
+     * @param {int} best_move - policy index of the best move from white's point of view (see parse_move_index), -1 if unknown.
+     * @returns {bool} false if the board has more than 32 pieces.
+     */
+    bool pack_board(const std::int8_t* board, int perspective, int rights, float score, PackedPosition& out, int best_move = -1);
+
+    /**
+     * Packs a position.
+     * @param {const libchess::Position&} pos - board position.
+     * @param {float} score - evaluation for the side to move.
+     * @param {PackedPosition&} out - receives the record.
+     * @param {int} best_move - policy index of the best move from white's point of view, -1 if unknown.
+     * @returns {bool} false if the position has more than 32 pieces.
+     */
+    bool pack(const libchess::Position& pos, float score, PackedPosition& out, int best_move = -1);
+
+    /**
+     * Best move label of a record.
+     * @param {const PackedPosition&} record - packed position.
+     * @returns {int} policy index for the side to move, -1 if unlabelled.
+     */
+    inline int packed_move(const PackedPosition& record) {
+        return record.best_move != 0 ? record.best_move : -1;
+    }
+
+    /**
+     * Lists the non-zero network inputs of a record (see serialize_sparse).
+     * @param {const PackedPosition&} record - packed position.
+     * @param {std::int16_t*} out - receives up to MAX_ACTIVE_FEATURES feature indices.
+     * @returns {int} number of active features.
+     */
+    int unpack_sparse(const PackedPosition& record, std::int16_t* out);
+
+    /**
+     * Decodes the network input of a record (see serialize).
+     * @param {const PackedPosition&} record - packed position.
+     * @param {float*} out - receives INPUT_SIZE floats.
+     */
+    void unpack(const PackedPosition& record, float* out);
+
+    /**
+     * Writes the header of a packed file.
+     * @param {std::ostream&} out - stream positioned at the start of the file.
+     * @param {size_t} count - number of records that follow.
+     */
+    void write_packed_header(std::ostream& out, size_t count);
+
+    /**
+     * Reads and validates the header of a packed file opened as a stream.
+     * @param {std::istream&} in - stream positioned at the start of the file.
+     * @param {size_t&} count - receives the number of records.
+     * @returns {bool} true if the stream holds a packed dataset.
+     */
+    bool read_packed_header(std::istream& in, size_t& count);
+
+    class MappedFile;
+
+    /**
+     * Validates a mapped packed file.
+     * @param {const MappedFile&} file - the mapped file.
+     * @param {size_t&} count - receives the number of records.
+     * @returns {const PackedPosition*} the records. Throws std::runtime_error if the file is not a packed dataset.
+     */
+    const PackedPosition* packed_records(const MappedFile& file, size_t& count);
+
+    /**
+     * Read-only memory mapping of a whole file.
+     */
+    class MappedFile {
+        private:
+            const void* data_{ nullptr };
+            size_t size_{ 0 };
+#ifdef _WIN32
+            void* file_handle{ nullptr };
+            void* mapping_handle{ nullptr };
+#endif
+
+            void close();
+
+        public:
+            /**
+             * Maps a file. Throws std::runtime_error if the file cannot be mapped.
+             * @param {const std::string&} path - file path.
+             */
+            explicit MappedFile(const std::string& path);
+            ~MappedFile();
+
+            MappedFile(MappedFile&& other) noexcept;
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            const void* data() const {
+                return data_;
+            }
+
+            size_t size() const {
+                return size_;
+            }
+    };
+}
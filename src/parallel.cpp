@@ -0,0 +1,220 @@
+#include "parallel.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace hydra {
+    namespace {
+        /**
+         * Parses a kernel CPU list such as "0-15,32-47".
+         * @param {const std::string&} list - CPU list.
+         * @returns {std::vector<int>} CPU ids.
+         */
+        std::vector<int> parse_cpu_list(const std::string& list) {
+            std::vector<int> cpus;
+            size_t i = 0;
+            auto number = [&]() {
+                int value = 0;
+                while (i < list.size() && list[i] >= '0' && list[i] <= '9') value = value * 10 + (list[i++] - '0');
+                return value;
+            };
+            while (i < list.size() && list[i] >= '0' && list[i] <= '9') {
+                int first = number();
+                int last = first;
+                if (i < list.size() && list[i] == '-') {
+                    i++;
+                    last = number();
+                }
+                for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+                if (i < list.size() && list[i] == ',') i++;
+            }
+            return cpus;
+        }
+    }
+
+    std::vector<std::vector<int>> numa_nodes() {
+        std::vector<std::pair<int, std::vector<int>>> found;
+#ifdef __linux__
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+            std::string name = entry.path().filename().string();
+            if (name.size() <= 4 || name.compare(0, 4, "node") != 0 ||
+                !std::all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; })) continue;
+            std::ifstream in(entry.path() / "cpulist");
+            std::string list;
+            std::getline(in, list);
+            //memory-only nodes have no CPUs
+            std::vector<int> cpus = parse_cpu_list(list);
+            if (!cpus.empty()) found.emplace_back(std::stoi(name.substr(4)), std::move(cpus));
+        }
+#endif
+        std::sort(found.begin(), found.end());
+        std::vector<std::vector<int>> nodes;
+        for (auto& node : found) nodes.push_back(std::move(node.second));
+        return nodes;
+    }
+
+    bool pin_thread(const std::vector<int>& cpus) {
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        return false;
+#endif
+    }
+
+    void DataParallel::Barrier::arrive_and_wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        size_t arrival = generation;
+        if (++waiting == parties) {
+            waiting = 0;
+            generation++;
+            cv.notify_all();
+            return;
+        }
+        cv.wait(lock, [&]() { return generation != arrival; });
+    }
+
+    DataParallel::DataParallel(Eval net, LossFn loss, int count)
+        : master(net), loss_fn(std::move(loss)), nodes(numa_nodes()),
+          replica_count(count > 0 ? count : std::max(1, static_cast<int>(nodes.size()))),
+          threads_per_replica(std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / replica_count)),
+          replicas(replica_count, nullptr), params(replica_count), weights(replica_count, 0), losses(replica_count, 0),
+          sync(replica_count + 1) {
+        //the intra-op pool is global to libtorch, so it is sized once, before the replicas start, for the replica
+        //with the fewest cores of its own
+        int node_count = static_cast<int>(nodes.size());
+        for (int node = 0; node < std::min(node_count, replica_count); node++) {
+            int sharing = (replica_count - 1 - node) / node_count + 1;
+            threads_per_replica = std::min(threads_per_replica, std::max(1, static_cast<int>(nodes[node].size()) / sharing));
+        }
+        torch::set_num_threads(threads_per_replica);
+        for (int i = 0; i < replica_count; i++) {
+            workers.emplace_back(&DataParallel::run, this, i);
+        }
+        //wait until every replica is built
+        sync.arrive_and_wait();
+    }
+
+    DataParallel::~DataParallel() {
+        stopping = true;
+        sync.arrive_and_wait();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    void DataParallel::run(int index) {
+        //replicas are spread over the nodes round robin and share their node's cores
+        if (!nodes.empty()) pin_thread(nodes[index % static_cast<int>(nodes.size())]);
+
+        //built on this thread after pinning, so its memory is first touched on the local node
+        Eval replica = master;
+        if (index > 0) {
+            replica = Eval();
+            torch::NoGradGuard no_grad;
+            std::vector<torch::Tensor> source = master->parameters();
+            std::vector<torch::Tensor> target = replica->parameters();
+            for (size_t i = 0; i < source.size(); i++) {
+                target[i].copy_(source[i]);
+            }
+            replica->train();
+        }
+        replicas[index] = replica;
+        params[index] = replica->parameters();
+        sync.arrive_and_wait();
+
+        while (true) {
+            //batch published
+            sync.arrive_and_wait();
+            if (stopping) return;
+
+            int64_t rows = inputs.size(0);
+            int64_t begin = rows * index / replica_count;
+            int64_t end = rows * (index + 1) / replica_count;
+            weights[index] = static_cast<double>(end - begin) / rows;
+            for (auto& param : params[index]) {
+                if (param.grad().defined()) param.mutable_grad().zero_();
+            }
+            torch::Tensor loss;
+            losses[index] = 0;
+            if (end > begin) {
+                loss = loss_fn(replica, inputs.narrow(0, begin, end - begin), targets.narrow(0, begin, end - begin));
+                losses[index] = loss.item<float>();
+            }
+            sync.arrive_and_wait();
+
+            if (loss.defined()) loss.backward();
+            sync.arrive_and_wait();
+
+            reduce(index);
+            sync.arrive_and_wait();
+
+            //master stepped: take its weights
+            sync.arrive_and_wait();
+            if (index > 0) {
+                torch::NoGradGuard no_grad;
+                for (size_t i = 0; i < params[index].size(); i++) {
+                    params[index][i].copy_(params[0][i]);
+                }
+            }
+            sync.arrive_and_wait();
+        }
+    }
+
+    void DataParallel::reduce(int index) {
+        //each replica sums its own share of every gradient, weighted by slice size, into the master's gradient
+        torch::NoGradGuard no_grad;
+        for (size_t i = 0; i < params[0].size(); i++) {
+            torch::Tensor total = params[0][i].grad();
+            if (!total.defined()) continue;
+            int64_t length = total.numel();
+            int64_t begin = length * index / replica_count;
+            int64_t end = length * (index + 1) / replica_count;
+            if (begin == end) continue;
+
+            torch::Tensor share = total.view(-1).narrow(0, begin, end - begin);
+            share.mul_(weights[0]);
+            for (int replica = 1; replica < replica_count; replica++) {
+                torch::Tensor grad = params[replica][i].grad();
+                if (grad.defined() && weights[replica] > 0) share.add_(grad.view(-1).narrow(0, begin, end - begin), weights[replica]);
+            }
+        }
+    }
+
+    float DataParallel::step(const torch::Tensor& batch_inputs, const torch::Tensor& batch_targets, torch::optim::Optimizer& optimizer,
+                             const std::function<void(TrainingMetrics::Phase)>& lap) {
+        inputs = batch_inputs;
+        targets = batch_targets;
+        sync.arrive_and_wait();
+
+        //forward passes
+        sync.arrive_and_wait();
+        lap(TrainingMetrics::FORWARD);
+
+        //backward passes, then the reduction
+        sync.arrive_and_wait();
+        sync.arrive_and_wait();
+        lap(TrainingMetrics::BACKWARD);
+
+        optimizer.step();
+        sync.arrive_and_wait();
+        sync.arrive_and_wait();
+        lap(TrainingMetrics::STEP);
+
+        double loss = 0;
+        for (int replica = 0; replica < replica_count; replica++) {
+            loss += weights[replica] * losses[replica];
+        }
+        return static_cast<float>(loss);
+    }
+}
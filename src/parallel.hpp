@@ -0,0 +1,124 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <torch/torch.h>
+#include "neural.hpp"
+#include "metrics.hpp"
+
+namespace hydra {
+    /**
+     * Lists the CPUs of each NUMA node.
+     * @returns {std::vector<std::vector<int>>} CPU ids per node; empty if the platform does not report a topology.
+     */
+    std::vector<std::vector<int>> numa_nodes();
+
+    /**
+     * Restricts the calling thread (and threads it starts afterwards) to a set of CPUs.
+     * @param {const std::vector<int>&} cpus - CPU ids.
+     * @returns {bool} true if the affinity was set.
+     */
+    bool pin_thread(const std::vector<int>& cpus);
+
+    /**
+     * Data-parallel training on the CPU. Every step the batch is split into one slice per model replica. Replicas
+     * run their forward and backward passes on their own threads, each pinned to a NUMA node so that its weights,
+     * activations and gradients stay in local memory. Gradients are averaged in shared memory, each replica reducing
+     * its own share of every parameter. A single optimizer steps the master network and the replicas copy its
+     * weights back, so all replicas hold the same weights at every step. libtorch has a single intra-op thread pool,
+     * so every replica runs with the same intra-op thread count, the share of cores of the most crowded node.
+     */
+    class DataParallel {
+        public:
+            /**
+             * Mean loss of a network on a batch: (network, inputs, targets).
+             */
+            using LossFn = std::function<torch::Tensor(Eval&, const torch::Tensor&, const torch::Tensor&)>;
+
+        private:
+            /**
+             * Reusable barrier for the replica threads and the coordinating thread.
+             */
+            class Barrier {
+                private:
+                    std::mutex mutex;
+                    std::condition_variable cv;
+                    int parties;
+                    int waiting{ 0 };
+                    size_t generation{ 0 };
+
+                public:
+                    explicit Barrier(int count) : parties(count) {}
+
+                    void arrive_and_wait();
+            };
+
+            Eval master;
+            LossFn loss_fn;
+            std::vector<std::vector<int>> nodes;                        //CPUs per NUMA node
+            int replica_count;
+            int threads_per_replica;                                    //intra-op threads (global to libtorch)
+
+            std::vector<Eval> replicas;
+            std::vector<std::vector<torch::Tensor>> params;             //parameters of each replica, in the same order
+
+            /**
+             * Current step: the batch, and each replica's slice weight and loss.
+             */
+            torch::Tensor inputs, targets;
+            std::vector<double> weights;
+            std::vector<float> losses;
+            bool stopping{ false };
+
+            Barrier sync;
+            std::vector<std::thread> workers;
+
+            /**
+             * Replica thread.
+             * @param {int} index - replica index; replica 0 trains the master network itself.
+             */
+            void run(int index);
+
+            /**
+             * Averages one replica's share of every gradient into the master's gradients.
+             * @param {int} index - replica index.
+             */
+            void reduce(int index);
+
+        public:
+            /**
+             * Starts the replica threads. The replicas are copies of the master network.
+             * @param {Eval} net - master network, on the CPU.
+             * @param {LossFn} loss - loss function.
+             * @param {int} count - number of replicas, 0 for one per NUMA node.
+             */
+            DataParallel(Eval net, LossFn loss, int count);
+
+            ~DataParallel();
+
+            DataParallel(const DataParallel&) = delete;
+            DataParallel& operator=(const DataParallel&) = delete;
+
+            /**
+             * Number of replicas.
+             * @returns {int} replica count.
+             */
+            int size() const {
+                return replica_count;
+            }
+
+            /**
+             * Runs one training step over the replicas.
+             * @param {const torch::Tensor&} batch_inputs - network inputs of the batch.
+             * @param {const torch::Tensor&} batch_targets - targets of the batch.
+             * @param {torch::optim::Optimizer&} optimizer - optimizer of the master network.
+             * @param {const std::function<void(TrainingMetrics::Phase)>&} lap - called as each phase of the step ends.
+             * @returns {float} mean loss over the batch.
+             */
+            float step(const torch::Tensor& batch_inputs, const torch::Tensor& batch_targets, torch::optim::Optimizer& optimizer,
+                       const std::function<void(TrainingMetrics::Phase)>& lap);
+    };
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+namespace hydra {
+    using pool_index = std::uint32_t;
+
+    /**
+     * Null pool index.
+     */
+    constexpr pool_index NULL_INDEX = UINT32_MAX;
+
+    /**
+     * Byte budget shared by several pools. Pools only allocate new chunks while the budget allows.
+     */
+    struct PoolBudget {
+        std::atomic<size_t> used{ 0 };  //bytes held by chunks
+        size_t limit{ SIZE_MAX };       //maximum bytes
+
+        /**
+         * Reserves memory for a chunk.
+         * @param {size_t} bytes - chunk size.
+         * @returns {bool} true if the budget allows it.
+         */
+        bool reserve(size_t bytes) {
+            if (used.fetch_add(bytes, std::memory_order_relaxed) + bytes > limit) {
+                used.fetch_sub(bytes, std::memory_order_relaxed);
+                return false;
+            }
+            return true;
+        }
+
+        /**
+         * Returns memory of a released chunk.
+         * @param {size_t} bytes - chunk size.
+         */
+        void give_back(size_t bytes) {
+            used.fetch_sub(bytes, std::memory_order_relaxed);
+        }
+    };
+
+    /**
+     * Chunked bump arena addressed by 32-bit indices. Allocation is a single atomic bump shared by all threads,
+     * objects never move once allocated, so indices (and references) stay valid while other threads allocate.
+     * Objects are never freed individually: the whole arena is reset at once and its chunks are reused.
+     * Objects must be trivially destructible. An optional budget caps the memory held by the arena.
+     */
+    template <typename T>
+    class Pool {
+        private:
+            static constexpr int CHUNK_BITS = 16;
+            static constexpr pool_index CHUNK_SIZE = pool_index(1) << CHUNK_BITS;
+            static constexpr pool_index MAX_CHUNKS = NULL_INDEX >> CHUNK_BITS; //keeps NULL_INDEX unreachable
+
+            /**
+             * Chunk table. Sized once on construction so lookups never race with growth.
+             */
+            std::unique_ptr<std::atomic<T*>[]> chunks;
+
+            /**
+             * Next free index.
+             */
+            std::atomic<pool_index> used{ 0 };
+
+            /**
+             * Memory budget the chunks are charged to (nullptr for unlimited).
+             */
+            PoolBudget* budget;
+
+            static constexpr size_t CHUNK_BYTES = sizeof(T) * CHUNK_SIZE;
+
+        public:
+            explicit Pool(PoolBudget* pool_budget = nullptr) : chunks(new std::atomic<T*>[MAX_CHUNKS]), budget(pool_budget) {
+                for (pool_index i = 0; i < MAX_CHUNKS; i++) {
+                    chunks[i].store(nullptr, std::memory_order_relaxed);
+                }
+            }
+
+            ~Pool() {
+                release();
+            }
+
+            Pool(const Pool&) = delete;
+            Pool& operator=(const Pool&) = delete;
+
+            /**
+             * Allocates a contiguous run of default constructed objects. Runs never straddle chunks.
+             * @param {pool_index} count - number of objects, at most one chunk.
+             * @returns {pool_index} index of the first object, or NULL_INDEX if the arena is full.
+             */
+            pool_index allocate(pool_index count) {
+                pool_index first;
+                pool_index end = used.load(std::memory_order_relaxed);
+                do {
+                    pool_index offset = end & (CHUNK_SIZE - 1);
+                    first = offset + count > CHUNK_SIZE ? end + (CHUNK_SIZE - offset) : end;
+                    if ((first >> CHUNK_BITS) >= MAX_CHUNKS) return NULL_INDEX;
+                } while (!used.compare_exchange_weak(end, first + count, std::memory_order_relaxed));
+
+                //first allocation in a chunk; racing threads agree on a single chunk
+                std::atomic<T*>& chunk = chunks[first >> CHUNK_BITS];
+                if (chunk.load(std::memory_order_acquire) == nullptr) {
+                    if (budget != nullptr && !budget->reserve(CHUNK_BYTES)) return NULL_INDEX;
+                    T* expected = nullptr;
+                    T* fresh = new T[CHUNK_SIZE];
+                    if (!chunk.compare_exchange_strong(expected, fresh, std::memory_order_acq_rel)) {
+                        delete[] fresh;
+                        if (budget != nullptr) budget->give_back(CHUNK_BYTES);
+                    }
+                }
+
+                for (pool_index i = first; i < first + count; i++) {
+                    new (&(*this)[i]) T();
+                }
+                return first;
+            }
+
+            /**
+             * Empties the arena in constant time. Chunks are kept for reuse.
+             * Must not be called while other threads use the arena.
+             */
+            void reset() {
+                used.store(0, std::memory_order_relaxed);
+            }
+
+            /**
+             * Empties the arena and returns its chunks to the system.
+             * Must not be called while other threads use the arena.
+             */
+            void release() {
+                for (pool_index i = 0; i < MAX_CHUNKS; i++) {
+                    T* chunk = chunks[i].exchange(nullptr, std::memory_order_relaxed);
+                    if (chunk != nullptr) {
+                        delete[] chunk;
+                        if (budget != nullptr) budget->give_back(CHUNK_BYTES);
+                    }
+                }
+                reset();
+            }
+
+            /**
+             * Number of indices handed out so far.
+             * @returns {size_t} arena size.
+             */
+            size_t size() const {
+                return used.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * Memory taken by the objects handed out so far. Unlike the budget, retained chunks of a reset arena
+             * are not counted, nor are indices handed out past the budget, whose chunks could not be reserved.
+             * @returns {size_t} bytes in use.
+             */
+            size_t bytes_in_use() const {
+                size_t end = size();
+                size_t objects = 0;
+                for (size_t chunk = 0; (chunk << CHUNK_BITS) < end; chunk++) {
+                    if (chunks[chunk].load(std::memory_order_relaxed) == nullptr) continue;
+                    objects += std::min<size_t>(CHUNK_SIZE, end - (chunk << CHUNK_BITS));
+                }
+                return objects * sizeof(T);
+            }
+
+            T& operator[](pool_index index) {
+                return chunks[index >> CHUNK_BITS].load(std::memory_order_acquire)[index & (CHUNK_SIZE - 1)];
+            }
+
+            const T& operator[](pool_index index) const {
+                return chunks[index >> CHUNK_BITS].load(std::memory_order_acquire)[index & (CHUNK_SIZE - 1)];
+            }
+    };
+}
@@ -0,0 +1,337 @@
+#include "quantize.hpp"
+#include "accumulator.hpp"
+#include "checkpoint.hpp"
+#include "config.hpp"
+#include "dataset.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#if defined(__AVX2__) || defined(__AVX512BW__)
+#include <immintrin.h>
+#endif
+
+namespace hydra {
+    namespace {
+        constexpr std::uint32_t FILE_MAGIC = 0x38515948; //"HYQ8"
+        constexpr std::uint32_t FILE_VERSION = 2; //version 1 files have no policy head
+
+        /**
+         * Padding of int8 rows (one AVX-512 register).
+         */
+        constexpr size_t INT8_LANES = 64;
+
+        constexpr float QUANT_MAX = 127; //keeps u8 x i8 pair sums of maddubs below the int16 limit
+
+        size_t int8_padded(size_t size) {
+            return (size + INT8_LANES - 1) / INT8_LANES * INT8_LANES;
+        }
+
+#if defined(__AVX512BW__)
+        /**
+         * Dot product of unsigned activations and signed weights. n is a multiple of INT8_LANES.
+         */
+        inline std::int32_t dot(const std::uint8_t* a, const std::int8_t* w, size_t n) {
+            __m512i acc = _mm512_setzero_si512();
+#if !defined(__AVX512VNNI__)
+            const __m512i ones = _mm512_set1_epi16(1);
+#endif
+            for (size_t i = 0; i < n; i += 64) {
+                __m512i av = _mm512_load_si512(a + i);
+                __m512i wv = _mm512_load_si512(w + i);
+#if defined(__AVX512VNNI__)
+                acc = _mm512_dpbusd_epi32(acc, av, wv);
+#else
+                acc = _mm512_add_epi32(acc, _mm512_madd_epi16(_mm512_maddubs_epi16(av, wv), ones));
+#endif
+            }
+            return _mm512_reduce_add_epi32(acc);
+        }
+#elif defined(__AVX2__)
+        inline std::int32_t dot(const std::uint8_t* a, const std::int8_t* w, size_t n) {
+            __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+            const __m256i ones = _mm256_set1_epi16(1);
+            for (size_t i = 0; i < n; i += 64) {
+                __m256i p0 = _mm256_maddubs_epi16(_mm256_load_si256(reinterpret_cast<const __m256i*>(a + i)),
+                                                  _mm256_load_si256(reinterpret_cast<const __m256i*>(w + i)));
+                __m256i p1 = _mm256_maddubs_epi16(_mm256_load_si256(reinterpret_cast<const __m256i*>(a + i + 32)),
+                                                  _mm256_load_si256(reinterpret_cast<const __m256i*>(w + i + 32)));
+                acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(p0, ones));
+                acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(p1, ones));
+            }
+            __m256i acc = _mm256_add_epi32(acc0, acc1);
+            __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+            return _mm_cvtsi128_si32(s);
+        }
+#else
+        inline std::int32_t dot(const std::uint8_t* a, const std::int8_t* w, size_t n) {
+            std::int32_t acc = 0;
+            for (size_t i = 0; i < n; i++) acc += static_cast<std::int32_t>(a[i]) * w[i];
+            return acc;
+        }
+#endif
+
+        template <typename T>
+        void write(std::ofstream& out, const T* data, size_t count) {
+            out.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+        }
+
+        template <typename T>
+        bool read(std::ifstream& in, T* data, size_t count) {
+            return static_cast<bool>(in.read(reinterpret_cast<char*>(data), count * sizeof(T)));
+        }
+
+        /**
+         * First layer pre-activations of a serialized position.
+         */
+        void first_layer_outputs(const FeatureWeights& weights, const float* input, float* out) {
+            std::memcpy(out, weights.biases(), HIDDEN_SIZE * sizeof(float));
+            for (int i = 0; i < INPUT_SIZE; i++) {
+                if (input[i] == 0) continue;
+                const float* column = weights.column(i);
+                for (size_t h = 0; h < HIDDEN_SIZE; h++) out[h] += input[i] * column[h];
+            }
+        }
+    }
+
+    QuantizedEval::Layer QuantizedEval::quantize_layer(const torch::nn::Linear& fc) {
+        torch::Tensor weight = fc->weight.detach().to(at::kCPU).to(at::kFloat).contiguous();
+        torch::Tensor bias = fc->bias.detach().to(at::kCPU).to(at::kFloat).contiguous();
+        Layer layer;
+        layer.outputs = weight.size(0);
+        layer.inputs = weight.size(1);
+        layer.stride = int8_padded(layer.inputs);
+        //the kernels read whole strides, the padding stays as zeroed by aligned_malloc
+        layer.weights = aligned_int8(static_cast<std::int8_t*>(aligned_malloc(layer.outputs * layer.stride)));
+        layer.scales.resize(layer.outputs);
+        layer.bias.assign(bias.data_ptr<float>(), bias.data_ptr<float>() + layer.outputs);
+        const float* src = weight.data_ptr<float>();
+        for (size_t o = 0; o < layer.outputs; o++) {
+            const float* row = src + o * layer.inputs;
+            float max_abs = 0;
+            for (size_t i = 0; i < layer.inputs; i++) max_abs = std::max(max_abs, std::abs(row[i]));
+            layer.scales[o] = max_abs > 0 ? max_abs / QUANT_MAX : 1;
+            for (size_t i = 0; i < layer.inputs; i++) {
+                layer.weights[o * layer.stride + i] = static_cast<std::int8_t>(std::lround(row[i] / layer.scales[o]));
+            }
+        }
+        return layer;
+    }
+
+    void QuantizedEval::quantize(Eval& net) {
+        torch::NoGradGuard no_grad;
+        layers.clear();
+        for (const torch::nn::Linear& fc : { net->fc1, net->fc2, net->fc3, net->fc4 }) {
+            layers.push_back(quantize_layer(fc));
+        }
+        //an untrained policy head is left out of the file, so the search keeps uniform priors
+        policy = net->policy_trained.item<float>() > 0 ? quantize_layer(net->policy) : Layer();
+        batch_capacity = 0;
+    }
+
+    bool QuantizedEval::save(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary);
+        //the policy head follows the value layers
+        std::vector<const Layer*> stored;
+        for (const Layer& layer : layers) stored.push_back(&layer);
+        if (policy.weights) stored.push_back(&policy);
+        std::uint32_t header[3] = { FILE_MAGIC, FILE_VERSION, static_cast<std::uint32_t>(stored.size()) };
+        write(out, header, 3);
+        for (const Layer* layer : stored) {
+            std::uint32_t dims[2] = { static_cast<std::uint32_t>(layer->outputs), static_cast<std::uint32_t>(layer->inputs) };
+            write(out, dims, 2);
+            write(out, layer->scales.data(), layer->outputs);
+            write(out, layer->bias.data(), layer->outputs);
+            for (size_t o = 0; o < layer->outputs; o++) {
+                write(out, &layer->weights[o * layer->stride], layer->inputs);
+            }
+        }
+        return static_cast<bool>(out);
+    }
+
+    bool QuantizedEval::load(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        std::uint32_t header[3];
+        if (!read(in, header, 3) || header[0] != FILE_MAGIC) return false;
+        bool valid_count = header[1] == 1 ? header[2] == 4 : header[1] == FILE_VERSION && (header[2] == 4 || header[2] == 5);
+        if (!valid_count) return false;
+        std::vector<Layer> loaded;
+        for (std::uint32_t l = 0; l < header[2]; l++) {
+            std::uint32_t dims[2];
+            if (!read(in, dims, 2)) return false;
+            Layer layer;
+            layer.outputs = dims[0];
+            layer.inputs = dims[1];
+            layer.stride = int8_padded(layer.inputs);
+            //layer sizes must match the network the rest of the engine is built for
+            size_t expected_inputs = l == 0 ? INPUT_SIZE : HIDDEN_SIZE;
+            size_t expected_outputs = l == 3 ? 1 : l == 4 ? POLICY_SIZE : HIDDEN_SIZE;
+            if (layer.inputs != expected_inputs || layer.outputs != expected_outputs) return false;
+            //the kernels read whole strides, the padding stays as zeroed by aligned_malloc
+            layer.weights = aligned_int8(static_cast<std::int8_t*>(aligned_malloc(layer.outputs * layer.stride)));
+            layer.scales.resize(layer.outputs);
+            layer.bias.resize(layer.outputs);
+            if (!read(in, layer.scales.data(), layer.outputs) || !read(in, layer.bias.data(), layer.outputs)) return false;
+            for (size_t o = 0; o < layer.outputs; o++) {
+                if (!read(in, &layer.weights[o * layer.stride], layer.inputs)) return false;
+            }
+            loaded.push_back(std::move(layer));
+        }
+        policy = Layer();
+        if (loaded.size() == 5) {
+            policy = std::move(loaded.back());
+            loaded.pop_back();
+        }
+        layers = std::move(loaded);
+        batch_capacity = 0;
+        return true;
+    }
+
+    void QuantizedEval::dequantize_layer(const Layer& layer, std::vector<float>& weight, std::vector<float>& bias) {
+        weight.resize(layer.outputs * layer.inputs);
+        for (size_t o = 0; o < layer.outputs; o++) {
+            for (size_t i = 0; i < layer.inputs; i++) {
+                weight[o * layer.inputs + i] = layer.weights[o * layer.stride + i] * layer.scales[o];
+            }
+        }
+        bias = layer.bias;
+    }
+
+    void QuantizedEval::first_layer(std::vector<float>& weight, std::vector<float>& bias) const {
+        dequantize_layer(layers[0], weight, bias);
+    }
+
+    bool QuantizedEval::policy_layer(std::vector<float>& weight, std::vector<float>& bias) const {
+        if (!policy.weights) return false;
+        dequantize_layer(policy, weight, bias);
+        return true;
+    }
+
+    void QuantizedEval::reserve(size_t batch) {
+        if (batch <= batch_capacity) return;
+        batch_capacity = batch;
+        quantized = aligned_uint8(static_cast<std::uint8_t*>(aligned_malloc(batch * int8_padded(HIDDEN_SIZE))));
+        input_scales.resize(batch);
+        hidden[0].resize(batch * HIDDEN_SIZE);
+        hidden[1].resize(batch * HIDDEN_SIZE);
+    }
+
+    void QuantizedEval::forward_hidden(const float* pre_activations, float* outputs, size_t batch) {
+        reserve(batch);
+        for (size_t i = 0; i < batch * HIDDEN_SIZE; i++) {
+            hidden[0][i] = std::max(pre_activations[i], 0.0f);
+        }
+        run(outputs, batch);
+    }
+
+    void QuantizedEval::run(float* outputs, size_t batch) {
+        int current = 0;
+        for (size_t l = 1; l < layers.size(); l++) {
+            const Layer& layer = layers[l];
+            bool last = l + 1 == layers.size();
+            const float* x = hidden[current].data();
+
+            //quantize activations, one scale per position (activations are non-negative after ReLU)
+            for (size_t b = 0; b < batch; b++) {
+                const float* row = x + b * layer.inputs;
+                float max_value = *std::max_element(row, row + layer.inputs);
+                float scale = max_value > 0 ? max_value / QUANT_MAX : 1;
+                input_scales[b] = scale;
+                std::uint8_t* q = &quantized[b * layer.stride];
+                for (size_t i = 0; i < layer.inputs; i++) {
+                    q[i] = static_cast<std::uint8_t>(std::lround(row[i] / scale));
+                }
+                //the kernels read whole strides; rows of a wider layer may have left data in the padding
+                std::memset(q + layer.inputs, 0, layer.stride - layer.inputs);
+            }
+
+            //int8 GEMM, int32 accumulation; each weight row stays in cache across the batch
+            float* y = last ? outputs : hidden[current ^ 1].data();
+            for (size_t o = 0; o < layer.outputs; o++) {
+                const std::int8_t* w = &layer.weights[o * layer.stride];
+                for (size_t b = 0; b < batch; b++) {
+                    float v = dot(&quantized[b * layer.stride], w, layer.stride) * input_scales[b] * layer.scales[o] + layer.bias[o];
+                    y[b * layer.outputs + o] = last ? std::tanh(v) : std::max(v, 0.0f);
+                }
+            }
+            current ^= 1;
+        }
+    }
+
+    void quantize(Eval net, const std::string& path) {
+        std::cout << "Quantizing Evaluator...\n";
+        std::string float_path = std::string(config::WEIGHTS_PATH) + "evaluator.pt";
+        std::string quantized_path = std::string(config::WEIGHTS_PATH) + "evaluator.q8";
+        load_weights(net, float_path);
+        net->eval();
+
+        QuantizedEval quantized;
+        quantized.quantize(net);
+        //round trip through the file so the report covers exactly what the engine loads
+        if (!quantized.save(quantized_path) || !quantized.load(quantized_path)) {
+            std::cout << "Could not write " << quantized_path << "\n";
+            return;
+        }
+        std::printf("Weights: %.1f MiB -> %.1f MiB\n",
+                    std::filesystem::file_size(float_path) / 1048576.0, std::filesystem::file_size(quantized_path) / 1048576.0);
+
+        //both networks start from the first layer's pre-activations, as in the search
+        CPUEval reference;
+        reference.load(net);
+        FeatureWeights float_first, quantized_first;
+        float_first.load(net);
+        std::vector<float> first_weight, first_bias;
+        quantized.first_layer(first_weight, first_bias);
+        quantized_first.load(first_weight.data(), first_bias.data());
+
+        std::cout << "Loading validation dataset...\n";
+        PositionDataset data_set(path, false);
+        size_t dataset_size = data_set.size().value();
+        if (dataset_size == 0) return;
+
+        constexpr size_t CHUNK = 256;
+        std::vector<float> float_pre(CHUNK * HIDDEN_SIZE), quantized_pre(CHUNK * HIDDEN_SIZE);
+        std::vector<float> float_out(CHUNK), quantized_out(CHUNK), targets(CHUNK);
+        double abs_error = 0, max_error = 0, float_sse = 0, quantized_sse = 0;
+        std::chrono::duration<double> float_time{ 0 }, quantized_time{ 0 };
+        for (size_t start = 0; start < dataset_size; start += CHUNK) {
+            size_t count = std::min(CHUNK, dataset_size - start);
+            std::vector<size_t> indices(count);
+            std::iota(indices.begin(), indices.end(), start);
+            torch::data::Example<> batch = data_set.get_batch(indices);
+            for (size_t i = 0; i < count; i++) {
+                const float* input = batch.data.data_ptr<float>() + i * INPUT_SIZE;
+                first_layer_outputs(float_first, input, &float_pre[i * HIDDEN_SIZE]);
+                first_layer_outputs(quantized_first, input, &quantized_pre[i * HIDDEN_SIZE]);
+                targets[i] = batch.target.data_ptr<float>()[i * batch.target.size(1) + TARGET_SCORE];
+            }
+
+            //evaluate one position at a time, as the search mostly does
+            auto t0 = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < count; i++) reference.forward_hidden(&float_pre[i * HIDDEN_SIZE], &float_out[i], 1);
+            auto t1 = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < count; i++) quantized.forward_hidden(&quantized_pre[i * HIDDEN_SIZE], &quantized_out[i], 1);
+            auto t2 = std::chrono::steady_clock::now();
+            float_time += t1 - t0;
+            quantized_time += t2 - t1;
+
+            for (size_t i = 0; i < count; i++) {
+                double error = std::abs(quantized_out[i] - float_out[i]);
+                abs_error += error;
+                max_error = std::max(max_error, error);
+                float_sse += (float_out[i] - targets[i]) * (float_out[i] - targets[i]);
+                quantized_sse += (quantized_out[i] - targets[i]) * (quantized_out[i] - targets[i]);
+            }
+        }
+
+        std::printf("Positions: %zu\n", dataset_size);
+        std::printf("Quantized vs float: mean abs error %.5f, max abs error %.5f\n", abs_error / dataset_size, max_error);
+        std::printf("MSE: float %.5f, quantized %.5f\n", float_sse / dataset_size, quantized_sse / dataset_size);
+        std::printf("Evals/s: float %.0f, quantized %.0f\n", dataset_size / float_time.count(), dataset_size / quantized_time.count());
+    }
+}
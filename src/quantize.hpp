@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "inference.hpp"
+#include "neural.hpp"
+
+namespace hydra {
+    /**
+     * Int8 copy of the value network. Weights are quantized symmetrically with one scale per output neuron,
+     * activations with one scale per position, and dot products accumulate in int32 (AVX-512 VNNI/BW or AVX2
+     * maddubs kernels, scalar fallback otherwise). The first layer is stored quantized too, but is dequantized
+     * for the search's float accumulators. Files of version 2 also hold the policy head.
+     */
+    class QuantizedEval {
+        private:
+            using aligned_int8 = std::unique_ptr<std::int8_t[], AlignedDeleter>;
+            using aligned_uint8 = std::unique_ptr<std::uint8_t[], AlignedDeleter>;
+
+            struct Layer {
+                size_t inputs;                                                                  //unpadded input width
+                size_t stride;                                                                  //padded input width
+                size_t outputs;
+                aligned_int8 weights;                                                           //outputs x stride
+                std::vector<float> scales;                                                      //per output neuron
+                std::vector<float> bias;
+            };
+
+            std::vector<Layer> layers;
+
+            /**
+             * Policy head, empty in files written before it existed or from networks whose head never trained.
+             * Only dequantized for the search.
+             */
+            Layer policy;
+
+            /**
+             * Quantizes a layer symmetrically, one scale per output neuron.
+             * @param {const torch::nn::Linear&} fc - trained layer.
+             * @returns {Layer} the quantized layer.
+             */
+            static Layer quantize_layer(const torch::nn::Linear& fc);
+
+            /**
+             * Dequantizes a layer.
+             * @param {const Layer&} layer - quantized layer.
+             * @param {std::vector<float>&} weight - receives outputs x inputs weights.
+             * @param {std::vector<float>&} bias - receives the biases.
+             */
+            static void dequantize_layer(const Layer& layer, std::vector<float>& weight, std::vector<float>& bias);
+
+            /**
+             * Quantized inputs and float outputs of the current batch.
+             */
+            aligned_uint8 quantized;
+            std::vector<float> input_scales;
+            std::vector<float> hidden[2];
+            size_t batch_capacity{ 0 };
+
+            void reserve(size_t batch);
+
+            /**
+             * Runs the int8 layers from the first hidden layer on, starting from its activations in hidden[0].
+             */
+            void run(float* outputs, size_t batch);
+
+        public:
+            /**
+             * Quantizes the weights of a trained network.
+             * @param {Eval&} net - the value network.
+             */
+            void quantize(Eval& net);
+
+            /**
+             * Writes the quantized weights.
+             * @param {const std::string&} path - file path.
+             * @returns {bool} true on success.
+             */
+            bool save(const std::string& path) const;
+
+            /**
+             * Reads quantized weights written by save.
+             * @param {const std::string&} path - file path.
+             * @returns {bool} true on success.
+             */
+            bool load(const std::string& path);
+
+            /**
+             * Dequantized first layer, for the search's accumulators.
+             * @param {std::vector<float>&} weight - receives HIDDEN_SIZE x INPUT_SIZE weights.
+             * @param {std::vector<float>&} bias - receives HIDDEN_SIZE biases.
+             */
+            void first_layer(std::vector<float>& weight, std::vector<float>& bias) const;
+
+            /**
+             * Dequantized policy head, for the search's move priors.
+             * @param {std::vector<float>&} weight - receives POLICY_SIZE x HIDDEN_SIZE weights.
+             * @param {std::vector<float>&} bias - receives POLICY_SIZE biases.
+             * @returns {bool} false if the file has no policy head.
+             */
+            bool policy_layer(std::vector<float>& weight, std::vector<float>& bias) const;
+
+            /**
+             * Evaluates a batch of positions from their first layer pre-activations (see Accumulator). Not thread safe:
+             * activation buffers are shared between calls.
+             * @param {const float*} pre_activations - batch x HIDDEN_SIZE first layer outputs before the activation.
+             * @param {float*} outputs - receives one evaluation per position.
+             * @param {size_t} batch - number of positions.
+             */
+            void forward_hidden(const float* pre_activations, float* outputs, size_t batch);
+    };
+
+    /**
+     * Quantizes the trained value network to evaluator.q8 and reports the accuracy and speed of the quantized
+     * network against the float one.
+     * @param {Eval} net - the value network to quantize.
+     * @param {const std::string&} path - path to a held-out dataset.
+     */
+    void quantize(Eval net, const std::string& path);
+}
@@ -1,159 +1,629 @@
 #include "search.hpp"
+#include "checkpoint.hpp"
 #include "config.hpp"
 #include "serialize.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
 namespace hydra {
     MCTSearch::MCTSearch() {
-        search_root = std::make_unique<MCTS_Node>();
-        std::random_device rd;
-        mt_eng = std::mt19937{rd()};
-        torch::load(value_net, std::string(config::WEIGHTS_PATH) + "evaluator.pt");
-        value_net->eval();
-        value_net->to(at::kCUDA);
+        tree_budget = std::make_unique<PoolBudget>();
+        spare_budget = std::make_unique<PoolBudget>();
+        node_pool = std::make_unique<Pool<MCTS_Node>>(tree_budget.get());
+        edge_pool = std::make_unique<Pool<MCTS_Edge>>(tree_budget.get());
+        spare_node_pool = std::make_unique<Pool<MCTS_Node>>(spare_budget.get());
+        spare_edge_pool = std::make_unique<Pool<MCTS_Edge>>(spare_budget.get());
+        set_hash_size(config::HASH_MB);
+        root_in_flight = std::make_unique<std::atomic<int>[]>(MAX_MOVES);
+        for (size_t i = 0; i < MAX_MOVES; i++) root_in_flight[i].store(0);
+
+        //choose evaluation backend (GPU if enabled and supported, otherwise the native int8 or float engine)
+        //the first layer is always computed incrementally on the CPU by the search threads
+        EvalQueue::Backend backend;
+        bool use_cuda = config::CUDA_INFERENCE && torch::cuda::is_available();
+        if (!use_cuda && config::INT8_INFERENCE && quantized_eval.load(std::string(config::WEIGHTS_PATH) + "evaluator.q8")) {
+            std::vector<float> weight, bias;
+            quantized_eval.first_layer(weight, bias);
+            feature_weights.load(weight.data(), bias.data());
+            //files quantized before the policy head, or from a network whose head never trained, leave the priors uniform
+            if (quantized_eval.policy_layer(weight, bias)) policy_head.load(weight.data(), bias.data());
+            backend = [this](const BatchBuffer& inputs, float* outputs, size_t batch) {
+                quantized_eval.forward_hidden(inputs.slot(0), outputs, batch);
+            };
+        }
+        else {
+            load_weights(value_net, std::string(config::WEIGHTS_PATH) + "evaluator.pt");
+            value_net->eval();
+            feature_weights.load(value_net);
+            //an untrained policy head would only add noise, the priors stay uniform without it
+            if (value_net->policy_trained.item<float>() > 0) policy_head.load(value_net);
+            if (use_cuda) {
+                value_net->to(at::kCUDA);
+                backend = [this](const BatchBuffer& inputs, float* outputs, size_t batch) {
+                    torch::NoGradGuard no_grad;
+                    //the batch buffer is page-locked, so the upload is asynchronous
+                    torch::Tensor values = value_net->forward_hidden(inputs.view(batch).to(at::kCUDA, true)).to(at::kCPU).contiguous();
+                    std::memcpy(outputs, values.data_ptr<float>(), batch * sizeof(float));
+                };
+            }
+            else {
+                cpu_eval.load(value_net);
+                backend = [this](const BatchBuffer& inputs, float* outputs, size_t batch) {
+                    cpu_eval.forward_hidden(inputs.slot(0), outputs, batch);
+                };
+            }
+        }
+        eval_cache.resize(static_cast<size_t>(config::EVAL_CACHE_MB) << 20);
+        eval_queue = std::make_unique<EvalQueue>(backend, &eval_cache, HIDDEN_SIZE, config::EVAL_BATCH_SIZE, std::chrono::microseconds(config::EVAL_FLUSH_US));
+    }
+
+    MCTSearch::~MCTSearch() {
+        wait_for_reclaim();
     }
 
-    MCTSearch::~MCTSearch() {}
+    void MCTSearch::rollout(libchess::Position& pos, const Accumulator& acc, MCTS_Leaf& leaf) {
+        //evaluated recently, skip the network
+        if (eval_cache.probe(pos.hash(), leaf.static_value)) return;
 
-    float MCTSearch::rollout(libchess::Position& pos) {
-        //NN evaluation
-        torch::Tensor pos_tensor = serialize(pos).unsqueeze(0).to(at::kCUDA);
-        float val = value_net->forward(pos_tensor)[0][0].item<float>();
-        return val;
+        //NN evaluation (batched with other in-flight leaves)
+        leaf.value = eval_queue->submit(acc.pre_activations(pos.side_to_move()), pos.hash());
     }
 
-    float MCTSearch::mcts_search(libchess::Position& pos, std::unique_ptr<MCTS_Node>& search_node, bool explore) {
-        //static evaluations
-        if (pos.game_state() != libchess::Position::GameState::IN_PROGRESS) {
-            float v{0};
-            if (pos.game_state() == libchess::Position::GameState::CHECKMATE) {
-                v = 10;
+    void MCTSearch::mcts_search(libchess::Position& pos, Accumulator& acc, MCTS_Node* search_node, MCTS_Leaf& leaf) {
+        //descend iteratively, making moves on the thread's position; the leaf's path is unwound at the end
+        MCTS_Node* node = search_node;
+        //value of the current node for its side to move, read before this descent's virtual loss reached its edge
+        float node_q = 0;
+        while (true) {
+            //apply virtual loss, removed again during back propogation
+            node->n.fetch_add(config::VIRTUAL_LOSS, std::memory_order_relaxed);
+            leaf.nodes.push_back(node);
+
+            //draws by rule depend on the path, so they are checked on every visit
+            if (pos.halfmoves() >= 100 || pos.is_repeat(2)) {
+                leaf.static_value = 0;
+                break;
             }
-            else {
-                v = 0;
+
+            //newly expanded node, setup stats and queue rollout
+            //checkmate and stalemate are only detected here, an expanded node always has moves
+            int state = node->state.load(std::memory_order_acquire);
+            if (state != MCTS_Node::EXPANDED) {
+                if (state == MCTS_Node::EXPANDING) {
+                    //another thread is expanding it
+                    leaf.collision = true;
+                    break;
+                }
+                libchess::MoveList move_list = pos.legal_move_list();
+                if (move_list.empty()) {
+                    leaf.static_value = pos.in_check() ? -10 : 0;
+                    break;
+                }
+                if (!node->state.compare_exchange_strong(state, MCTS_Node::EXPANDING)) {
+                    //another thread got here first
+                    leaf.collision = true;
+                    break;
+                }
+                pool_index edge_count = static_cast<pool_index>(move_list.size());
+                pool_index first_edge = edge_pool->allocate(edge_count);
+                if (first_edge == NULL_INDEX) {
+                    //tree is full, evaluate the node without expanding it
+                    tree_full = true;
+                    node->state.store(MCTS_Node::UNEXPANDED, std::memory_order_release);
+                    rollout(pos, acc, leaf);
+                    break;
+                }
+                //move priors from the policy head, read off this thread's accumulator
+                float priors[MAX_MOVES];
+                if (policy_head.available()) {
+                    int stm = pos.side_to_move().value();
+                    int indices[MAX_MOVES];
+                    int* index = indices;
+                    for (const auto& move : move_list) {
+                        *index++ = policy_index(stm, move.from_square().value(), move.to_square().value());
+                    }
+                    policy_head.priors(acc.pre_activations(pos.side_to_move()), indices, edge_count, priors);
+                }
+                else {
+                    std::fill(priors, priors + edge_count, 1.0f / edge_count);
+                }
+                pool_index i = 0;
+                for (const auto& move : move_list) {
+                    MCTS_Edge& edge = (*edge_pool)[first_edge + i];
+                    edge.move = move.value();
+                    edge.prior = priors[i++];
+                }
+                node->position_hash = pos.hash();
+                node->edges = first_edge;
+                node->edge_count = static_cast<std::uint16_t>(edge_count);
+                node->state.store(MCTS_Node::EXPANDED, std::memory_order_release);
+                rollout(pos, acc, leaf);
+                break;
             }
-            search_node->w += v;
-            search_node->n++;
-            return -v;
-        }
 
-        //newly expanded node, setup stats and perform rollout
-        if (!search_node->visited) {
-            search_node->visited = true; 
-            search_node->w = -rollout(pos);
-            search_node->n = 1;
-            search_node->position_hash = pos.hash();
-            search_node->move_list = pos.legal_move_list();
-            return -search_node->w;
-        }
+            //choose next move which maximizes the PUCT (edges are contiguous, so this is a linear scan)
+            //unvisited moves get the parent's value less a reduction, so the priors decide which are tried;
+            //at the root every move is tried once
+            float fpu = leaf.edges.empty() ? INFINITY : node_q - config::FPU_REDUCTION;
+            float max_puct = -INFINITY;
+            MCTS_Edge* edges = &(*edge_pool)[node->edges];
+            MCTS_Edge* best_edge = edges;
+            float sqrt_n = sqrtf(static_cast<float>(node->n.load(std::memory_order_relaxed)));
+            for (MCTS_Edge* edge = edges; edge != edges + node->edge_count; edge++) {
+                float puct = edge->PUCT(sqrt_n, fpu);
+                if (puct > max_puct) {
+                    max_puct = puct;
+                    best_edge = edge;
+                }
+            }
+            int chosen_n = best_edge->n.load(std::memory_order_relaxed);
+            node_q = chosen_n > 0 ? -best_edge->w.load(std::memory_order_relaxed) / chosen_n : 0;
+            atomic_add(best_edge->w, -config::VIRTUAL_LOSS);
+            best_edge->n.fetch_add(config::VIRTUAL_LOSS, std::memory_order_relaxed);
+            if (leaf.edges.empty()) root_in_flight[best_edge - edges].fetch_add(1, std::memory_order_relaxed);
+            leaf.edges.push_back(best_edge);
 
-        //choose next move which maximizes the UCT
-        float max_uct = -INFINITY;
-        libchess::Move best_move;
-        std::uniform_real_distribution<> dist(0.0, 1.0);
-        for (const auto& move : search_node->move_list) {
-            auto& child = search_node->children.find(move.value_sans_type());
-            //if the node is unexplored
-            if (child == search_node->children.end()) {
-                max_uct = INFINITY;
-                best_move = move;
-                break;
+            //continue selection (or expansion if leaf node)
+            acc.make_move(pos, libchess::Move{best_edge->move});
+            pool_index child = best_edge->child.load(std::memory_order_acquire);
+            if (child == NULL_INDEX) {
+                child = attach_child(*best_edge, pos);
             }
-            float uct = child->second->UCT();
-            //add some random noise to the search if it is exploratory.
-            if (explore)
-                uct += dist(mt_eng);
-            if (uct > max_uct) {
-                max_uct = uct;
-                best_move = move;
+            if (child == NULL_INDEX) {
+                //tree is full, the edge keeps the statistics of the unstored child
+                tree_full = true;
+                evaluate_unstored(pos, acc, leaf);
+                break;
             }
+            node = &(*node_pool)[child];
         }
 
-        //continue selection (or expansion if leaf node)
-        auto& next_node = search_node->children[best_move.value_sans_type()];
-        if (next_node == nullptr) {
-            next_node = std::make_unique<MCTS_Node>();
-            next_node->parent = search_node.get();
+        //back to the root position
+        for (size_t i = 0; i < leaf.edges.size(); i++) {
+            acc.unmake_move(pos);
         }
+    }
+
+    pool_index MCTSearch::attach_child(MCTS_Edge& edge, const libchess::Position& pos) {
+        //a transposition reuses the node of the same position reached by another move order
+        pool_index child = use_transpositions ? transpositions.find(pos.hash()) : NULL_INDEX;
+        bool fresh = child == NULL_INDEX;
+        if (fresh) {
+            child = node_pool->allocate(1);
+            if (child == NULL_INDEX) return NULL_INDEX;
+            (*node_pool)[child].position_hash = pos.hash();
+        }
+        //if another thread attached a child first, use theirs; a fresh node was not published and stays unused
+        pool_index attached = NULL_INDEX;
+        if (!edge.child.compare_exchange_strong(attached, child, std::memory_order_acq_rel)) return attached;
+        //publish the node only once an edge reaches it. If another move order published the position meanwhile,
+        //this edge keeps its own copy
+        if (fresh && use_transpositions) transpositions.insert(pos.hash(), child);
+        return child;
+    }
 
-        //recurse down tree
-        pos.make_move(best_move);
-        float v = mcts_search(pos, next_node, explore);
-        pos.unmake_move();
+    void MCTSearch::backpropagate(MCTS_Leaf& leaf) {
+        //leaf value from the side to move's perspective
+        float v = leaf.value.valid() ? leaf.value.get() : leaf.static_value;
+        int visit = leaf.collision ? 0 : 1;
 
         //back propogate stats (and remove virtual loss)
-        search_node->w += v;
-        search_node->n += 1;
-        return -v;
+        for (MCTS_Node* node : leaf.nodes) {
+            node->n.fetch_add(visit - config::VIRTUAL_LOSS, std::memory_order_relaxed);
+        }
+        for (auto edge = leaf.edges.rbegin(); edge != leaf.edges.rend(); edge++) {
+            v = -v;
+            atomic_add((*edge)->w, visit * v + config::VIRTUAL_LOSS);
+            (*edge)->n.fetch_add(visit - config::VIRTUAL_LOSS, std::memory_order_relaxed);
+        }
+        if (!leaf.edges.empty()) {
+            root_in_flight[leaf.edges.front() - &(*edge_pool)[leaf.nodes.front()->edges]].fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    void MCTSearch::evaluate_unstored(libchess::Position& pos, const Accumulator& acc, MCTS_Leaf& leaf) {
+        if (pos.halfmoves() >= 100 || pos.is_repeat(2)) {
+            leaf.static_value = 0;
+        }
+        else if (pos.legal_move_list().empty()) {
+            leaf.static_value = pos.in_check() ? -10 : 0;
+        }
+        else {
+            rollout(pos, acc, leaf);
+        }
+    }
+
+    const char* SearchSummary::name(Reason reason) {
+        switch (reason) {
+            case BUDGET:        return "budget";
+            case STOPPED:       return "stopped";
+            case HARD_DEADLINE: return "hard deadline";
+            case SOFT_DEADLINE: return "soft deadline";
+            case SINGLE_MOVE:   return "single move";
+            case FUTILE:        return "futile";
+            case KLD_GAIN:      return "kld gain";
+            default:            return "running";
+        }
+    }
+
+    int MCTSearch::completed_root_visits(const MCTS_Node& root, pool_index i, float& w) const {
+        //descents still in flight have added virtual loss to the edge's visits and total action
+        int pending = root_in_flight[i].load(std::memory_order_acquire);
+        const MCTS_Edge& edge = (*edge_pool)[root.edges + i];
+        w = edge.w.load(std::memory_order_relaxed) + pending * config::VIRTUAL_LOSS;
+        return std::max(edge.n.load(std::memory_order_relaxed) - pending * config::VIRTUAL_LOSS, 0);
+    }
+
+    double MCTSearch::kld_gain(int playouts) {
+        const MCTS_Node& root = (*node_pool)[search_root];
+        std::vector<int> visits(root.edge_count);
+        double total = 0;
+        for (pool_index i = 0; i < root.edge_count; i++) {
+            float w;
+            visits[i] = completed_root_visits(root, i, w);
+            total += visits[i];
+        }
+
+        //KL divergence of the previous visit distribution from the current one
+        double gain = INFINITY;
+        if (kld_visits.size() == visits.size() && playouts > kld_playouts && total > 0) {
+            double previous_total = 0;
+            for (int n : kld_visits) previous_total += n;
+            double divergence = 0;
+            for (size_t i = 0; i < visits.size(); i++) {
+                if (kld_visits[i] <= 0 || visits[i] <= 0) continue;
+                double p = kld_visits[i] / previous_total;
+                divergence += p * std::log(p / (visits[i] / total));
+            }
+            gain = divergence / (playouts - kld_playouts);
+        }
+        kld_visits = std::move(visits);
+        kld_playouts = playouts;
+        return gain;
+    }
+
+    bool MCTSearch::search_finished(const TimeManager& limits, int playouts) {
+        if (limits.infinite()) return false;
+        TimeManager::clock::time_point now = TimeManager::clock::now();
+        if (limits.past_hard(now)) {
+            summary.reason = SearchSummary::HARD_DEADLINE;
+            summary.saved_playouts = summary.saved_seconds = 0;
+            return true;
+        }
+
+        //most and second most visited root moves, and the move with the best value
+        const MCTS_Node& root = (*node_pool)[search_root];
+        int best_n = 0, second_n = 0;
+        float best_q = -INFINITY;
+        pool_index most_visited = NULL_INDEX, best_valued = NULL_INDEX;
+        for (pool_index i = 0; i < root.edge_count; i++) {
+            float edge_w;
+            int edge_n = completed_root_visits(root, i, edge_w);
+            if (edge_n > best_n) {
+                second_n = best_n;
+                best_n = edge_n;
+                most_visited = i;
+            }
+            else if (edge_n > second_n) {
+                second_n = edge_n;
+            }
+            if (edge_n > 0 && edge_w / edge_n > best_q) {
+                best_q = edge_w / edge_n;
+                best_valued = i;
+            }
+        }
+        if (limits.past_soft(now) && most_visited == best_valued) {
+            summary.reason = SearchSummary::SOFT_DEADLINE;
+            summary.saved_playouts = summary.saved_seconds = 0;
+            return true;
+        }
+
+        //playouts and time the rest of the search can still spend, at the current rate if the search is timed
+        double elapsed = limits.elapsed(now);
+        double rate = elapsed > 0 ? playouts / elapsed : 0;
+        double remaining = static_cast<double>(limits.playout_limit()) - playouts;
+        if (limits.has_deadline()) remaining = std::min(remaining, rate * limits.remaining(now));
+        summary.saved_playouts = remaining;
+        summary.saved_seconds = limits.has_deadline() ? limits.remaining(now) : (rate > 0 ? remaining / rate : 0);
+
+        if (root.edge_count == 1 && playouts > 0) {
+            summary.reason = SearchSummary::SINGLE_MOVE;
+            return true;
+        }
+        if (best_n - second_n > remaining) {
+            summary.reason = SearchSummary::FUTILE;
+            return true;
+        }
+        if (config::KLD_GAIN_MIN > 0 && playouts - kld_playouts >= config::KLD_INTERVAL && kld_gain(playouts) < config::KLD_GAIN_MIN) {
+            summary.reason = SearchSummary::KLD_GAIN;
+            return true;
+        }
+        return false;
     }
 
-    libchess::Move MCTSearch::choose_best_move(libchess::Position& pos, const bool& stopped_flag, int& out_score) {
+    libchess::Move MCTSearch::choose_best_move(libchess::Position& pos, const std::atomic<bool>& stopped_flag, const TimeManager& limits, int& out_score) {
+        wait_for_reclaim();
+
         //validate tree cache
-        if (search_root->position_hash != pos.hash()) {
+        if ((*node_pool)[search_root].position_hash != pos.hash()) {
             std::cout << "Cache miss.\n";
-            search_root = std::make_unique<MCTS_Node>();
+            reset_tree();
+            (*node_pool)[search_root].position_hash = pos.hash();
+            if (use_transpositions) transpositions.insert(pos.hash(), search_root);
         }
-        
+
         //perfrom iterations of MCTS
-        //exploration passes (background thread(s)):
-        std::vector<std::unique_ptr<MCTS_Node>> r_search_roots(config::THREAD_CNT - 1); 
-        std::vector<std::thread> search_threads(config::THREAD_CNT - 1);
-        for (int thread_id = 0; thread_id < config::THREAD_CNT - 1; thread_id++) {
-            r_search_roots[thread_id] = std::move(std::make_unique<MCTS_Node>());
-            auto& r_search_root = r_search_roots[thread_id];
-            search_threads[thread_id] = std::move(std::thread([&]() {
-                for (int iter = 0; iter < config::MCTS_ITERATIONS && !stopped_flag; iter++) {
-                    mcts_search(libchess::Position{pos}, r_search_root, true);
+        //all threads descend the shared tree, each keeping several descents in flight so the evaluation queue can batch them
+        //the main thread checks the limits after each round of descents and raises halted for all threads
+        std::atomic<int> iterations_left{ limits.playout_limit() };
+        std::atomic<int> playouts{ 0 };
+        std::atomic<bool> halted{ false };
+        summary = SearchSummary();
+        kld_visits.clear();
+        kld_playouts = 0;
+        auto running = [&]() {
+            return !stopped_flag.load(std::memory_order_relaxed) && !halted.load(std::memory_order_relaxed);
+        };
+        auto search_worker = [&](bool main_thread) {
+            libchess::Position thread_pos{pos};
+            Accumulator acc(feature_weights);
+            acc.reset(thread_pos);
+            std::vector<MCTS_Leaf> leaves(config::INFLIGHT_LEAVES);
+            while (iterations_left.load(std::memory_order_relaxed) > 0 && running() && !(prune_full_tree && tree_full)) {
+                size_t in_flight = 0;
+                for (; in_flight < leaves.size() && running() && iterations_left.fetch_sub(1, std::memory_order_relaxed) > 0; in_flight++) {
+                    leaves[in_flight].nodes.clear();
+                    leaves[in_flight].edges.clear();
+                    leaves[in_flight].value = {};
+                    leaves[in_flight].collision = false;
+                    mcts_search(thread_pos, acc, &(*node_pool)[search_root], leaves[in_flight]);
                 }
-            }));
+                for (size_t i = 0; i < in_flight; i++) {
+                    backpropagate(leaves[i]);
+                }
+                int done = playouts.fetch_add(static_cast<int>(in_flight), std::memory_order_relaxed) + static_cast<int>(in_flight);
+                if (main_thread && search_finished(limits, done)) halted = true;
+            }
+        };
+        while (true) {
+            //helper threads:
+            std::vector<std::thread> search_threads(config::THREAD_CNT - 1);
+            for (auto& thread : search_threads) {
+                thread = std::thread(search_worker, false);
+            }
+            //main thread:
+            search_worker(true);
+            //join helper threads
+            for (auto& thread : search_threads) {
+                thread.join();
+            }
+            if (!(prune_full_tree && tree_full) || !running() || iterations_left.load() <= 0) break;
+            //out of memory: keep the most visited part of the tree and carry on searching
+            reclaim();
         }
-        //greedy pass (main thread):
-        for (int iter = 0; iter < config::MCTS_ITERATIONS && !stopped_flag; iter++) {
-            mcts_search(libchess::Position{pos}, search_root, false);
+
+        //a ponder or infinite search that ran out of budget must not answer before stop or ponderhit
+        while (limits.infinite() && !stopped_flag.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
-        //join background threads
-        for (auto& thread : search_threads) {
-            thread.join();
+
+        summary.playouts = playouts.load();
+        if (!halted) {
+            summary.reason = stopped_flag ? SearchSummary::STOPPED : SearchSummary::BUDGET;
+            summary.saved_playouts = summary.saved_seconds = 0;
         }
-        //choose move with highest visit count
-        float max_n = -INFINITY;
-        libchess::Move best_move;
-        for (auto& move : pos.legal_move_list()) {
-            //get greedy node stats
-            auto& child_greedy = search_root->children[move.value_sans_type()];
-            float greedy_n = child_greedy != nullptr ? child_greedy->n : 0;
 
-            //get all explore node stats
-            float local_max_n = greedy_n;
-            for (auto& r_search_root : r_search_roots) {
-               auto& child_explore = r_search_root->children[move.value_sans_type()];
-               float explore_n = child_explore != nullptr ? child_explore->n : 0;
-               local_max_n = std::max(local_max_n, explore_n);
-            }
+        //tree usage of this search, before the reclaimer swaps the generations
+        summary.hashfull = hashfull();
 
-            if (local_max_n > max_n) {
-                max_n = local_max_n;
-                best_move = move;
+        //choose move with highest visit count
+        MCTS_Node& root = (*node_pool)[search_root];
+        int max_n = -1;
+        float total_w = 0;
+        int total_n = 0;
+        libchess::Move best_move;
+        for (pool_index i = root.edges; i < root.edges + root.edge_count; i++) {
+            MCTS_Edge& edge = (*edge_pool)[i];
+            int edge_n = edge.n.load();
+            if (edge_n > max_n) {
+                max_n = edge_n;
+                best_move = libchess::Move{edge.move};
             }
+            total_w += edge.w.load();
+            total_n += edge_n;
         }
 
         //calculate predicted score
-        float score = -search_root->w / search_root->n;
+        float score = total_n > 0 ? total_w / total_n : 0;
         float max_ = 5000;
         float min_ = -5000;
         score = std::min(std::max((score+1)*(max_-min_)/2 + min_, min_), max_); //reverse normalize
         out_score = static_cast<int>(score);
 
-        //move search tree down to chosen node
-        shift_tree_down(best_move.value_sans_type());
+        if (limits.pondering()) {
+            //stopped while pondering, so the opponent played another move: keep the tree of the position before the
+            //expected move, which may hold the subtree of the actual one
+            if (parent_root != NULL_INDEX) search_root = parent_root;
+        }
+        else if (shift_tree_down(best_move.value_sans_type())) {
+            //move search tree down to chosen node, whose most visited reply is the one to ponder on
+            const MCTS_Node& reply_root = (*node_pool)[search_root];
+            int reply_n = 0;
+            if (reply_root.state.load() == MCTS_Node::EXPANDED) {
+                for (pool_index i = reply_root.edges; i < reply_root.edges + reply_root.edge_count; i++) {
+                    const MCTS_Edge& edge = (*edge_pool)[i];
+                    if (edge.n.load() > reply_n) {
+                        reply_n = edge.n.load();
+                        summary.ponder_move = libchess::Move{edge.move};
+                    }
+                }
+            }
+        }
+
+        //free the rest of the tree while the opponent thinks
+        reclaimer = std::thread(&MCTSearch::reclaim, this);
         return best_move;
     }
 
+    pool_index MCTSearch::copy_tree(pool_index node, Pool<MCTS_Node>& nodes, Pool<MCTS_Edge>& edges) {
+        //copies a node and its edges, leaving the children to be attached later
+        auto copy_node = [&](pool_index src_index) {
+            const MCTS_Node& src = (*node_pool)[src_index];
+            pool_index copy = nodes.allocate(1);
+            pool_index first_edge = src.edge_count > 0 ? edges.allocate(src.edge_count) : NULL_INDEX;
+            if (copy == NULL_INDEX || (src.edge_count > 0 && first_edge == NULL_INDEX)) return NULL_INDEX;
+            MCTS_Node& dst = nodes[copy];
+            dst.state.store(src.state.load());
+            dst.n.store(src.n.load());
+            dst.edges = first_edge;
+            dst.edge_count = src.edge_count;
+            dst.position_hash = src.position_hash;
+            for (pool_index i = 0; i < src.edge_count; i++) {
+                const MCTS_Edge& src_edge = (*edge_pool)[src.edges + i];
+                MCTS_Edge& dst_edge = edges[first_edge + i];
+                dst_edge.w.store(src_edge.w.load());
+                dst_edge.n.store(src_edge.n.load());
+                dst_edge.prior = src_edge.prior;
+                dst_edge.move = src_edge.move;
+            }
+            return copy;
+        };
+
+        //transpositions are shared by several edges and must only be copied once
+        std::unordered_map<pool_index, pool_index> copies;
+        if (use_transpositions) transpositions.clear();
+        auto record_copy = [&](pool_index src_index, pool_index copy) {
+            copies[src_index] = copy;
+            if (use_transpositions) transpositions.insert(nodes[copy].position_hash, copy);
+        };
+
+        pool_index copy = copy_node(node);
+        if (copy == NULL_INDEX) return NULL_INDEX;
+        record_copy(node, copy);
+
+        //attach children most visited first, so if the budget runs out the least visited subtrees are the ones dropped
+        using Pending = std::tuple<int, pool_index, pool_index>; //edge visits, source edge, destination edge
+        std::priority_queue<Pending> frontier;
+        auto push_edges = [&](pool_index src_index, pool_index dst_index) {
+            const MCTS_Node& src = (*node_pool)[src_index];
+            const MCTS_Node& dst = nodes[dst_index];
+            for (pool_index i = 0; i < src.edge_count; i++) {
+                const MCTS_Edge& src_edge = (*edge_pool)[src.edges + i];
+                if (src_edge.child.load() != NULL_INDEX) {
+                    frontier.emplace(src_edge.n.load(), src.edges + i, dst.edges + i);
+                }
+            }
+        };
+        push_edges(node, copy);
+        while (!frontier.empty()) {
+            auto [visits, src_edge, dst_edge] = frontier.top();
+            frontier.pop();
+            pool_index src_child = (*edge_pool)[src_edge].child.load();
+            auto copied = copies.find(src_child);
+            if (copied != copies.end()) {
+                edges[dst_edge].child.store(copied->second);
+                continue;
+            }
+            pool_index dst_child = copy_node(src_child);
+            if (dst_child == NULL_INDEX) break;
+            record_copy(src_child, dst_child);
+            edges[dst_edge].child.store(dst_child);
+            push_edges(src_child, dst_child);
+        }
+        return copy;
+    }
+
+    void MCTSearch::reset_tree() {
+        node_pool->reset();
+        edge_pool->reset();
+        transpositions.clear();
+        search_root = node_pool->allocate(1);
+        parent_root = NULL_INDEX;
+        tree_full = false;
+    }
+
+    void MCTSearch::reclaim() {
+        spare_node_pool->reset();
+        spare_edge_pool->reset();
+        pool_index copy = copy_tree(search_root, *spare_node_pool, *spare_edge_pool);
+        if (copy == NULL_INDEX) {
+            //not even the root fits in the spare generation, start over
+            spare_node_pool->release();
+            spare_edge_pool->release();
+            reset_tree();
+            return;
+        }
+        search_root = copy;
+        parent_root = NULL_INDEX;
+        std::swap(node_pool, spare_node_pool);
+        std::swap(edge_pool, spare_edge_pool);
+        std::swap(tree_budget, spare_budget);
+        spare_node_pool->release();
+        spare_edge_pool->release();
+        apply_budget_limits();
+        tree_full = false;
+    }
+
+    void MCTSearch::apply_budget_limits() {
+        size_t tree_bytes = hash_bytes - transpositions.bytes();
+        tree_budget->limit = tree_bytes / 3 * 2;
+        spare_budget->limit = tree_bytes / 3;
+    }
+
+    void MCTSearch::set_hash_size(int megabytes) {
+        wait_for_reclaim();
+        hash_bytes = static_cast<size_t>(megabytes) << 20;
+        transpositions.resize(hash_bytes / config::TT_SHARE);
+        apply_budget_limits();
+        node_pool->release();
+        edge_pool->release();
+        reset_tree();
+    }
+
+    void MCTSearch::set_use_transpositions(bool use) {
+        wait_for_reclaim();
+        use_transpositions = use;
+        transpositions.clear();
+    }
+
+    void MCTSearch::clear_eval_cache() {
+        eval_cache.clear();
+    }
+
+    const EvalCache& MCTSearch::evaluation_cache() const {
+        return eval_cache;
+    }
+
+    void MCTSearch::set_prune_full_tree(bool prune) {
+        prune_full_tree = prune;
+    }
+
+    const SearchSummary& MCTSearch::last_search() const {
+        return summary;
+    }
+
+    int MCTSearch::hashfull() const {
+        size_t live = node_pool->bytes_in_use() + edge_pool->bytes_in_use();
+        return static_cast<int>(std::min<size_t>(live * 1000 / tree_budget->limit, 1000));
+    }
+
+    void MCTSearch::wait_for_reclaim() {
+        if (reclaimer.joinable()) reclaimer.join();
+    }
+
     bool MCTSearch::shift_tree_down(libchess::Move::value_type move) {
-        auto&& next_node = search_root->children.find(move);
-        if (next_node != search_root->children.end()) {
-            search_root = std::move(next_node->second);
-            return true;
+        wait_for_reclaim();
+
+        const MCTS_Node& root = (*node_pool)[search_root];
+        for (pool_index i = root.edges; i < root.edges + root.edge_count; i++) {
+            const MCTS_Edge& edge = (*edge_pool)[i];
+            if (libchess::Move{edge.move}.value_sans_type() == move && edge.child.load() != NULL_INDEX) {
+                parent_root = search_root;
+                search_root = edge.child.load();
+                return true;
+            }
         }
         return false;
     }
-}
\ No newline at end of file
+}
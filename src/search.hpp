@@ -1,40 +1,185 @@
 #pragma once
 
-#include <unordered_map>
 #include <memory>
-#include <random>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <queue>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 #include <Position.h>
 #include "neural.hpp"
+#include "evalqueue.hpp"
+#include "evalcache.hpp"
+#include "inference.hpp"
+#include "accumulator.hpp"
+#include "quantize.hpp"
+#include "pool.hpp"
+#include "transposition.hpp"
+#include "timeman.hpp"
 
 namespace hydra {
     /**
-     * A node in the search tree. Holds total evaluation, number of visits, and the child node pointers.
+     * More than the legal moves of any position (218), bounds per-move buffers.
      */
-    struct MCTS_Node {
-        bool visited                                                                        {  false  }; //visited flag
-        float w                                                                             {    0    }; //total action
-        float n                                                                             {    0    }; //visit count
-        MCTS_Node* parent                                                                   { nullptr }; //parent node*
-        libchess::MoveList move_list;                                                                    //move list cache
-        libchess::Position::hash_type position_hash;                                                     //position hash
-        std::unordered_map<libchess::Move::value_type, std::unique_ptr<MCTS_Node>> children;             //child nodes
+    constexpr size_t MAX_MOVES = 256;
+
+    /**
+     * Atomically adds to a float. std::atomic<float>::fetch_add is only available from C++20.
+     * @param {std::atomic<float>&} target - the value to add to.
+     * @param {float} value - the amount to add.
+     */
+    inline void atomic_add(std::atomic<float>& target, float value) {
+        float current = target.load(std::memory_order_relaxed);
+        while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed));
+    }
+
+    /**
+     * A move out of a search node. Edges of a node are stored contiguously so selection is a linear scan,
+     * and hold the statistics of the move so the child node itself is only touched when descending into it.
+     */
+    struct MCTS_Edge {
+        std::atomic<float> w                                                                {    0    }; //total action
+        std::atomic<int> n                                                                  {    0    }; //visit count (including virtual loss)
+        std::atomic<pool_index> child                                                       { NULL_INDEX }; //child node index
+        float prior                                                                         {    0    }; //move prior
+        std::uint32_t move                                                                  {    0    }; //move value
 
         /**
-         * Calculates the UCT value of the search node.
+         * Calculates the PUCT value of the edge: its value plus an exploration term weighted by the move prior.
+         * @param {float} sqrt_parent_n - square root of the parent visit count.
+         * @param {float} fpu - value assumed for the edge while it is unvisited.
          */ 
-        float UCT() const {
-            float Q = w / n;
-            float U = config::C_PUCT * sqrtf(parent->n) / (n + 1);
+        float PUCT(float sqrt_parent_n, float fpu) const {
+            float visits = static_cast<float>(n.load(std::memory_order_relaxed));
+            float Q = visits > 0 ? w.load(std::memory_order_relaxed) / visits : fpu;
+            float U = config::C_PUCT * prior * sqrt_parent_n / (visits + 1);
             return Q + U;
         }
     };
 
+    /**
+     * A node in the search tree. Holds the number of visits and the range of its edges in the edge pool.
+     * With transpositions enabled a node can be the child of several edges.
+     * The tree is shared by all search threads: stats are atomic, and the edges are written once by the
+     * thread that expands the node and are only updated through their atomics once state is EXPANDED.
+     */
+    struct MCTS_Node {
+        enum State : int { UNEXPANDED, EXPANDING, EXPANDED };
+
+        std::atomic<int> state                                                              { UNEXPANDED }; //expansion state
+        std::atomic<int> n                                                                  {    0    }; //visit count (including virtual loss)
+        pool_index edges                                                                    { NULL_INDEX }; //first edge index
+        std::uint16_t edge_count                                                            {    0    }; //number of edges
+        libchess::Position::hash_type position_hash                                         {    0    }; //position hash
+    };
+
+    /**
+     * A descent waiting on its leaf evaluation. Holds the selected path so the stats can be backed up once the value arrives.
+     * Each search thread reuses its leaves for the whole search, so the paths are stacks whose storage is only allocated
+     * while the tree deepens.
+     */
+    struct MCTS_Leaf {
+        std::vector<MCTS_Node*> nodes;                                                                   //nodes from root to leaf
+        std::vector<MCTS_Edge*> edges;                                                                   //edges taken between them
+        std::future<float> value;                                                                        //pending network evaluation
+        float static_value                                                                  { 0 };       //value of a terminal leaf or a cached evaluation
+        bool collision                                                                      { false };   //leaf is being expanded by another thread
+    };
+
+    /**
+     * How a search ended, and the part of its budget it left unused by ending early.
+     */
+    struct SearchSummary {
+        enum Reason { RUNNING, BUDGET, STOPPED, HARD_DEADLINE, SOFT_DEADLINE, SINGLE_MOVE, FUTILE, KLD_GAIN };
+
+        Reason reason                                                                       { RUNNING }; //why the search ended
+        int playouts                                                                        {    0    }; //playouts searched
+        double saved_playouts                                                               {    0    }; //playouts left in the budget
+        double saved_seconds                                                                {    0    }; //time left in the budget
+        int hashfull                                                                        {    0    }; //permille of the tree budget in use when the search ended
+        std::optional<libchess::Move> ponder_move;                                                       //expected reply to the chosen move
+
+        /**
+         * Name of a stop reason for the info output.
+         * @param {Reason} reason - the stop reason.
+         * @returns {const char*} the name.
+         */
+        static const char* name(Reason reason);
+    };
+
     class MCTSearch {
         private:
+            /**
+             * Search tree storage. Children are referred to by index into the node pool.
+             */
+            std::unique_ptr<Pool<MCTS_Node>> node_pool;
+            std::unique_ptr<Pool<MCTS_Edge>> edge_pool;
+
+            /**
+             * Storage for the next generation of the tree. The subtree kept after a move is copied here in
+             * the background, after which the generations are swapped and the old one is released wholesale.
+             */
+            std::unique_ptr<Pool<MCTS_Node>> spare_node_pool;
+            std::unique_ptr<Pool<MCTS_Edge>> spare_edge_pool;
+
+            /**
+             * Background reclamation thread.
+             */
+            std::thread reclaimer;
+
+            /**
+             * Memory budgets of the current and spare generations. The search tree may use two thirds of the hash
+             * size and reclamation keeps at most one third, so the two generations never exceed the hash size together.
+             */
+            std::unique_ptr<PoolBudget> tree_budget;
+            std::unique_ptr<PoolBudget> spare_budget;
+            size_t hash_bytes;
+
+            /**
+             * Set when the tree ran out of memory and a node could not be stored.
+             */
+            std::atomic<bool> tree_full{ false };
+
+            /**
+             * Position hash to node map used to merge transpositions.
+             */
+            TransTable transpositions;
+            bool use_transpositions{ config::TRANSPOSITIONS };
+
+            /**
+             * When the tree is full, pause the search and prune the least visited subtrees instead of
+             * only no longer expanding.
+             */
+            bool prune_full_tree{ false };
+
             /**
              * Search tree root.
              */
-            std::unique_ptr<MCTS_Node> search_root;
+            pool_index search_root;
+
+            /**
+             * Root before the last shift down, kept until the next reclamation so a ponder miss can return to it.
+             */
+            pool_index parent_root{ NULL_INDEX };
+
+            /**
+             * Outcome of the last search.
+             */
+            SearchSummary summary;
+
+            /**
+             * Root visit counts and playouts at the last KLD gain check.
+             */
+            std::vector<int> kld_visits;
+            int kld_playouts{ 0 };
+
+            /**
+             * Descents in flight through each root edge, whose virtual loss is still in the edge's visit count.
+             */
+            std::unique_ptr<std::atomic<int>[]> root_in_flight;
 
             /**
              * Value network.
@@ -42,46 +187,202 @@ namespace hydra {
             Eval value_net;
 
             /**
-             * Random engine.
+             * libtorch-free forward pass of the value network, used unless evaluating on CUDA.
+             */
+            CPUEval cpu_eval;
+
+            /**
+             * Int8 forward pass of the value network, used when quantized weights are available.
+             */
+            QuantizedEval quantized_eval;
+
+            /**
+             * First layer weights for the search threads' accumulators.
              */
-            std::mt19937 mt_eng;
+            FeatureWeights feature_weights;
 
             /**
-             * Determines the value of the current node statically using the value network.
+             * Policy head for the move priors of expanded nodes, uniform priors without one.
+             */
+            PolicyHead policy_head;
+
+            /**
+             * Recent value network evaluations, shared by all search threads and kept across moves.
+             */
+            EvalCache eval_cache;
+
+            /**
+             * Batches leaf evaluations from all search threads.
+             */
+            std::unique_ptr<EvalQueue> eval_queue;
+
+            /**
+             * Queues the current node for static evaluation by the value network, unless its evaluation is cached.
              * @param {libchess::Position&} pos - The current board state.
-             * @returns {float} The value of the node.
+             * @param {const Accumulator&} acc - first layer pre-activations of the current board state.
+             * @param {MCTS_Leaf&} leaf - Receives the cached value, or the pending evaluation.
              */
-            float rollout(libchess::Position& pos);
+            void rollout(libchess::Position& pos, const Accumulator& acc, MCTS_Leaf& leaf);
 
             /**
              * One iteration of MCTS goes through 4 stages.
-             * 1) selection: traverse down tree nodes which maximize UCT.
-             * 2) expansion: if a selected node is unexplored, add it to the search tree.
-             * 3) simulation: perform a rollout on the the new node to determine its value.
-             * 4) back-propogation: send the statistics up the search three.
+             * 1) selection: traverse down tree nodes which maximize PUCT. Unvisited moves are valued at the parent's
+             *    value minus config::FPU_REDUCTION, except at the root where every move is tried once.
+             * 2) expansion: if a selected node is unexplored, add it to the search tree with the policy head's priors.
+             * 3) simulation: queue a rollout on the the new node to determine its value.
+             * 4) back-propogation: send the statistics up the search three (see backpropagate).
+             * Virtual loss is applied along the selected path so that other in-flight descents, from this or any other
+             * search thread, choose different leaves. The descent is a loop: moves are made on the thread's position as
+             * it goes down and unmade once the leaf is reached, so deep lines cost no stack.
+             * @param {libchess::Position&} pos - The current board state.
+             * @param {Accumulator&} acc - first layer pre-activations along the path, updated with each move.
+             * @param {MCTS_Node*} search_node - The node the descent starts from.
+             * @param {MCTS_Leaf&} leaf - Receives the selected path and its pending evaluation.
+             */
+            void mcts_search(libchess::Position& pos, Accumulator& acc, MCTS_Node* search_node, MCTS_Leaf& leaf);
+
+            /**
+             * Waits for a leaf evaluation, then sends the statistics up the selected path and removes its virtual loss.
+             * Collided descents only remove their virtual loss.
+             * @param {MCTS_Leaf&} leaf - The completed descent.
+             */
+            void backpropagate(MCTS_Leaf& leaf);
+
+            /**
+             * Attaches a child node to an edge, sharing the node of a transposition when there is one.
+             * @param {MCTS_Edge&} edge - the edge taken.
+             * @param {const libchess::Position&} pos - the position after the edge's move.
+             * @returns {pool_index} the child node, or NULL_INDEX if the tree is full.
+             */
+            pool_index attach_child(MCTS_Edge& edge, const libchess::Position& pos);
+
+            /**
+             * Evaluates a position whose node could not be stored because the tree is full.
              * @param {libchess::Position&} pos - The current board state.
-             * @param {std::unique_ptr<MCTS_Node>&} search_node - The search node in the tree.
-             * @returns {float} Terminal node evaluation.
+             * @param {const Accumulator&} acc - first layer pre-activations of the current board state.
+             * @param {MCTS_Leaf&} leaf - Receives the pending evaluation.
+             */
+            void evaluate_unstored(libchess::Position& pos, const Accumulator& acc, MCTS_Leaf& leaf);
+
+            /**
+             * Copies a subtree into another pair of pools, most visited nodes first, and rebuilds the transposition
+             * table for it. Subtrees that do not fit in the budget of the destination pools are dropped; their edges
+             * keep their statistics.
+             * @param {pool_index} node - root of the subtree in the current pools.
+             * @param {Pool<MCTS_Node>&} nodes - destination node pool.
+             * @param {Pool<MCTS_Edge>&} edges - destination edge pool.
+             * @returns {pool_index} root of the copy in the destination pools, NULL_INDEX if even the root does not fit.
+             */
+            pool_index copy_tree(pool_index node, Pool<MCTS_Node>& nodes, Pool<MCTS_Edge>& edges);
+
+            /**
+             * Discards the search tree and starts a new one in constant time.
+             */
+            void reset_tree();
+
+            /**
+             * Copies the current tree into the spare generation and releases everything that is no longer reachable
+             * from the root. Runs on the reclaimer thread.
+             */
+            void reclaim();
+
+            /**
+             * Blocks until any background reclamation has finished.
+             */
+            void wait_for_reclaim();
+
+            /**
+             * Splits the hash size between the current and spare generations.
+             */
+            void apply_budget_limits();
+
+            /**
+             * Decides whether the search can end: the hard deadline passed, the soft deadline passed and the most
+             * visited root move also has the best value, the search is futile (the most visited move leads by more
+             * visits than the remaining budget can give any other move), or the root visit distribution has stopped
+             * changing (KLD gain below config::KLD_GAIN_MIN). Records the reason and the unused budget in the summary.
+             * @param {const TimeManager&} limits - limits of the search.
+             * @param {int} playouts - playouts completed so far.
+             * @returns {bool} true if the search should stop.
+             */
+            bool search_finished(const TimeManager& limits, int playouts);
+
+            /**
+             * Statistics of a root edge without the virtual loss of the descents still in flight through it.
+             * @param {const MCTS_Node&} root - the root node.
+             * @param {pool_index} i - index of the edge among the root's edges.
+             * @param {float&} w - receives the total action of the completed visits.
+             * @returns {int} completed visits.
              */
-            float mcts_search(libchess::Position& pos, std::unique_ptr<MCTS_Node>& search_node, bool explore);
+            int completed_root_visits(const MCTS_Node& root, pool_index i, float& w) const;
+
+            /**
+             * Measures how much the distribution of completed root visits moved since the previous check.
+             * @param {int} playouts - playouts completed so far.
+             * @returns {double} KL divergence per playout since the previous check, or INFINITY on the first check.
+             */
+            double kld_gain(int playouts);
+
+            /**
+             * How full the search tree is. Only valid while no reclamation runs.
+             * @returns {int} permille of the tree budget used by the live tree.
+             */
+            int hashfull() const;
 
         public:
             /**
-             * Performs several iterations of MCTS and then chooses the optimal move.
+             * Performs iterations of MCTS until the limits are reached and then chooses the optimal move.
              * @param {libchess::Position&} pos - The current position.
-             * @param {const bool&} stopped_flag - A flag used for terminating the search early.
+             * @param {const std::atomic<bool>&} stopped_flag - A flag used for terminating the search early.
+             * @param {const TimeManager&} limits - Time and playout limits of the search.
              * @param {int&} out_score - The predicted score from the network.
              * @returns {libchess::Move} The optimal move.
              */
-            libchess::Move choose_best_move(libchess::Position& pos, const bool& stopped_flag, int& out_score);
+            libchess::Move choose_best_move(libchess::Position& pos, const std::atomic<bool>& stopped_flag, const TimeManager& limits, int& out_score);
+
+            /**
+             * Outcome of the last search.
+             * @returns {const SearchSummary&} playouts, stop reason and saved budget.
+             */
+            const SearchSummary& last_search() const;
 
             /**
-             * Shift tree root down and destroys all other branches of tree.
+             * Shift tree root down in constant time. The other branches of the tree are reclaimed in the background
+             * after the next search.
              * @param {libchess::Move::value_type} move - the move to shift tree down by.
              * @returns {bool} true on success.
              */ 
             bool shift_tree_down(libchess::Move::value_type move);
 
+            /**
+             * Sets the memory budget of the search tree. Clears the tree.
+             * @param {int} megabytes - the budget in MiB.
+             */
+            void set_hash_size(int megabytes);
+
+            /**
+             * Enables or disables merging transpositions.
+             * @param {bool} use - share nodes between move orders reaching the same position.
+             */
+            void set_use_transpositions(bool use);
+
+            /**
+             * Chooses what happens when the tree is full.
+             * @param {bool} prune - prune the least visited subtrees rather than stop expanding.
+             */
+            void set_prune_full_tree(bool prune);
+
+            /**
+             * Empties the evaluation cache, e.g. for a new game.
+             */
+            void clear_eval_cache();
+
+            /**
+             * Evaluation cache statistics.
+             * @returns {const EvalCache&} the evaluation cache.
+             */
+            const EvalCache& evaluation_cache() const;
+
             MCTSearch();
 
             ~MCTSearch();
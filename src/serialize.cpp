@@ -1,31 +1,42 @@
 #include "serialize.hpp"
+#include <algorithm>
 
 namespace hydra {
-    torch::Tensor serialize(libchess::Position pos) {
-        uint8_t data[12 * 64 + 4] = {0};
+    int active_features(const libchess::Position& pos, int perspective, std::int16_t* out) {
+        int count = 0;
 
-        //vlip so P1 = white
-        if (pos.side_to_move() == libchess::constants::BLACK) pos.vflip();
-
-        //loop through each board square
-        for (int i = 0; i < 64; i++) {
-            //loop through each piece
-            for (libchess::Color color = libchess::constants::WHITE; color <= libchess::constants::BLACK; color++) {
-                for (libchess::PieceType piece = libchess::constants::PAWN; piece <= libchess::constants::KING; piece++) {
-                    auto bitboard = pos.piece_type_bb(piece, color);
-                    //set blob location
-                    if (bitboard & libchess::Bitboard(i)) data[(color * 6 + piece) * 64 + i] = 1;
+        //scan each piece bitboard
+        for (libchess::Color color = libchess::constants::WHITE; color <= libchess::constants::BLACK; color++) {
+            for (libchess::PieceType piece = libchess::constants::PAWN; piece <= libchess::constants::KING; piece++) {
+                for (libchess::Bitboard bb = pos.piece_type_bb(piece, color); bb; bb.forward_popbit()) {
+                    out[count++] = piece_feature(perspective, color.value(), piece.value(), bb.forward_bitscan().value());
                 }
             }
         }
 
-        //set castling rights
-        if (pos.castling_rights().is_allowed(libchess::constants::WHITE_KINGSIDE)) data[12 * 64 + 0] = 1;
-        if (pos.castling_rights().is_allowed(libchess::constants::WHITE_QUEENSIDE)) data[12 * 64 + 1] = 1;
-        if (pos.castling_rights().is_allowed(libchess::constants::BLACK_KINGSIDE)) data[12 * 64 + 2] = 1;
-        if (pos.castling_rights().is_allowed(libchess::constants::BLACK_QUEENSIDE)) data[12 * 64 + 3] = 1;
+        //castling rights
+        int rights = pos.castling_rights().value();
+        for (int right = 0; right < 4; right++) {
+            if (rights & (1 << right)) out[count++] = castling_feature(perspective, right);
+        }
+        return count;
+    }
+
+    int serialize_sparse(const libchess::Position& pos, std::int16_t* out) {
+        return active_features(pos, pos.side_to_move() == libchess::constants::BLACK ? 1 : 0, out);
+    }
+
+    void serialize(const libchess::Position& pos, float* out) {
+        std::fill(out, out + INPUT_SIZE, 0.0f);
+        std::int16_t features[MAX_ACTIVE_FEATURES];
+        int count = serialize_sparse(pos, features);
+        for (int i = 0; i < count; i++) {
+            out[features[i]] = 1;
+        }
+    }
 
-        //generate tensor
-        return torch::from_blob(data, {12 * 64 + 4}, at::kByte).to(at::kFloat).clone();
+    BatchBuffer::BatchBuffer(size_t capacity, size_t row_width) : rows(capacity), width(row_width) {
+        auto options = torch::TensorOptions().dtype(at::kFloat).pinned_memory(torch::cuda::is_available());
+        storage = torch::zeros({ static_cast<int64_t>(rows), static_cast<int64_t>(width) }, options);
     }
-}
\ No newline at end of file
+}
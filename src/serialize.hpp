@@ -1,13 +1,170 @@
 #pragma once
 
+#include <cstdint>
 #include <torch/torch.h>
 #include <Position.h>
 
 namespace hydra {
     /**
-     * Serialize a board position to a tensor.
-     * @param {libchess::Position} pos - board position.
-     * @returns {torch::Tensor} tensor.
-     */ 
-    torch::Tensor serialize(libchess::Position pos);
-}
\ No newline at end of file
+     * Size of a serialized position: 12 piece planes of 64 squares and 4 castling rights.
+     */
+    constexpr int INPUT_SIZE = 12 * 64 + 4;
+
+    /**
+     * Maximum number of non-zero inputs: 32 pieces and 4 castling rights.
+     */
+    constexpr int MAX_ACTIVE_FEATURES = 32 + 4;
+
+    /**
+     * Input feature of a piece as seen by one side. The network always sees the board from the side to move:
+     * from black's point of view colours are swapped and ranks mirrored.
+     * @param {int} perspective - 0 for white, 1 for black.
+     * @param {int} color - colour of the piece.
+     * @param {int} piece - piece type.
+     * @param {int} square - square of the piece.
+     * @returns {int} feature index.
+     */
+    inline int piece_feature(int perspective, int color, int piece, int square) {
+        if (perspective == 0) return (color * 6 + piece) * 64 + square;
+        return ((color ^ 1) * 6 + piece) * 64 + (square ^ 56);
+    }
+
+    /**
+     * Input feature of a castling right as seen by one side.
+     * @param {int} perspective - 0 for white, 1 for black.
+     * @param {int} right - bit index: white kingside, white queenside, black kingside, black queenside.
+     * @returns {int} feature index.
+     */
+    inline int castling_feature(int perspective, int right) {
+        return 12 * 64 + (perspective == 0 ? right : right ^ 2);
+    }
+
+    /**
+     * Mirrors a feature list left to right (a-file to h-file). Castling is tied to the a and h files, so this is only
+     * a symmetry of positions without castling rights.
+     * @param {std::int16_t*} features - active feature indices, mirrored in place.
+     * @param {int} count - number of features.
+     * @returns {bool} false, leaving the features unchanged, if a castling feature is present.
+     */
+    inline bool mirror_files(std::int16_t* features, int count) {
+        for (int i = 0; i < count; i++) {
+            if (features[i] >= 12 * 64) return false;
+        }
+        for (int i = 0; i < count; i++) {
+            features[i] ^= 7;
+        }
+        return true;
+    }
+
+    /**
+     * Number of policy outputs: one per origin and destination square. Promotions share the index of their squares.
+     */
+    constexpr int POLICY_SIZE = 64 * 64;
+
+    /**
+     * Policy output of a move as seen by one side (ranks mirrored for black, like the input features).
+     * @param {int} perspective - 0 for white, 1 for black.
+     * @param {int} from - origin square.
+     * @param {int} to - destination square.
+     * @returns {int} policy index.
+     */
+    inline int policy_index(int perspective, int from, int to) {
+        if (perspective == 0) return from * 64 + to;
+        return (from ^ 56) * 64 + (to ^ 56);
+    }
+
+    /**
+     * Policy index of a move in a position mirrored by mirror_files.
+     * @param {int} index - policy index.
+     * @returns {int} the mirrored index.
+     */
+    inline int mirror_policy(int index) {
+        return index ^ (7 * 64 + 7);
+    }
+
+    /**
+     * Parses the squares of a move in UCI notation (e.g. e2e4, e7e8q).
+     * @param {const char*} begin - first character.
+     * @param {const char*} end - one past the last character.
+     * @returns {int} policy index from white's point of view, or -1 if the text is not a move.
+     */
+    inline int parse_move_index(const char* begin, const char* end) {
+        size_t length = static_cast<size_t>(end - begin);
+        if (length != 4 && length != 5) return -1;
+        for (int i = 0; i < 4; i += 2) {
+            if (begin[i] < 'a' || begin[i] > 'h' || begin[i + 1] < '1' || begin[i + 1] > '8') return -1;
+        }
+        if (length == 5 && begin[4] != 'q' && begin[4] != 'r' && begin[4] != 'b' && begin[4] != 'n') return -1;
+        int from = (begin[1] - '1') * 8 + (begin[0] - 'a');
+        int to = (begin[3] - '1') * 8 + (begin[2] - 'a');
+        return from == to ? -1 : policy_index(0, from, to);
+    }
+
+    /**
+     * Lists the non-zero inputs of a position as seen by one side.
+     * @param {const libchess::Position&} pos - board position.
+     * @param {int} perspective - 0 for white, 1 for black.
+     * @param {std::int16_t*} out - receives up to MAX_ACTIVE_FEATURES feature indices.
+     * @returns {int} number of active features.
+     */
+    int active_features(const libchess::Position& pos, int perspective, std::int16_t* out);
+
+    /**
+     * Serialize a board position from the side to move's point of view as the indices of its non-zero inputs.
+     * @param {const libchess::Position&} pos - board position.
+     * @param {std::int16_t*} out - receives up to MAX_ACTIVE_FEATURES feature indices.
+     * @returns {int} number of active features.
+     */
+    int serialize_sparse(const libchess::Position& pos, std::int16_t* out);
+
+    /**
+     * Serialize a board position from the side to move's point of view.
+     * @param {const libchess::Position&} pos - board position.
+     * @param {float*} out - receives INPUT_SIZE floats.
+     */
+    void serialize(const libchess::Position& pos, float* out);
+
+    /**
+     * Reusable buffer of serialized positions, one row per position. Page-locked when CUDA is available so
+     * host-to-device copies are asynchronous.
+     */
+    class BatchBuffer {
+        private:
+            torch::Tensor storage;
+            size_t rows;
+            size_t width;
+
+        public:
+            /**
+             * @param {size_t} capacity - maximum number of rows.
+             * @param {size_t} row_width - floats per row.
+             */
+            BatchBuffer(size_t capacity, size_t row_width);
+
+            /**
+             * Row of a position.
+             * @param {size_t} index - row index.
+             * @returns {float*} row_width floats.
+             */
+            float* slot(size_t index) {
+                return storage.data_ptr<float>() + index * width;
+            }
+
+            const float* slot(size_t index) const {
+                return storage.data_ptr<float>() + index * width;
+            }
+
+            /**
+             * The first rows as a tensor, without copying.
+             * @param {size_t} count - number of rows.
+             * @returns {torch::Tensor} count x row_width tensor sharing the buffer.
+             */
+            torch::Tensor view(size_t count) const {
+                return storage.narrow(0, 0, static_cast<int64_t>(count));
+            }
+
+            size_t capacity() const {
+                return rows;
+            }
+    };
+}
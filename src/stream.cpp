@@ -0,0 +1,149 @@
+#include "stream.hpp"
+#include "dataset.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace hydra {
+    namespace {
+        constexpr size_t BLOCK_RECORDS = 4096; //records per read (128 KiB)
+        constexpr size_t READ_AHEAD = 4;       //blocks buffered per prefetch thread
+    }
+
+    ShardStream::ShardStream(const std::string& path, size_t batch, size_t shuffle_size, int threads, std::uint64_t random_seed, bool sparse_input, bool mirror)
+        : batch_size(batch), shuffle_capacity(std::max(shuffle_size, batch)), thread_count(std::max(threads, 1)), seed(random_seed), sparse(sparse_input),
+          augment(mirror) {
+        for (const auto& entry : std::filesystem::directory_iterator(path)) {
+            if (entry.is_regular_file() && entry.path().extension() == ".bin") shard_paths.push_back(entry.path().string());
+        }
+        std::sort(shard_paths.begin(), shard_paths.end());
+
+        //only headers are read up front
+        for (const std::string& shard : shard_paths) {
+            std::ifstream in(shard, std::ios::binary);
+            size_t count;
+            if (!read_packed_header(in, count)) throw std::runtime_error(shard + " is not a packed dataset");
+            total += count;
+        }
+    }
+
+    ShardStream::~ShardStream() {
+        stop_readers();
+    }
+
+    void ShardStream::start_epoch() {
+        stop_readers();
+        cancelled = false;
+        rng.seed(seed + epoch++);
+
+        std::vector<size_t> order(shard_paths.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        std::shuffle(order.begin(), order.end(), rng);
+
+        readers.clear();
+        for (int t = 0; t < thread_count; t++) {
+            readers.push_back(std::make_unique<Reader>());
+        }
+        for (size_t i = 0; i < order.size(); i++) {
+            readers[i % thread_count]->shards.push_back(order[i]);
+        }
+        for (auto& reader : readers) {
+            reader->thread = std::thread(&ShardStream::read_shards, this, std::ref(*reader));
+        }
+        next_reader = 0;
+        shuffle_buffer.clear();
+        shuffle_buffer.reserve(shuffle_capacity + BLOCK_RECORDS);
+    }
+
+    void ShardStream::stop_readers() {
+        cancelled = true;
+        for (auto& reader : readers) {
+            {
+                //taking the lock orders the flag before the reader's next predicate check
+                std::lock_guard<std::mutex> lock(reader->mutex);
+            }
+            reader->cv.notify_all();
+            if (reader->thread.joinable()) reader->thread.join();
+        }
+        readers.clear();
+    }
+
+    void ShardStream::read_shards(Reader& reader) {
+        for (size_t shard : reader.shards) {
+            std::ifstream in(shard_paths[shard], std::ios::binary);
+            size_t remaining;
+            if (!read_packed_header(in, remaining)) continue;
+            while (remaining > 0) {
+                std::vector<PackedPosition> block(std::min(remaining, BLOCK_RECORDS));
+                if (!in.read(reinterpret_cast<char*>(block.data()), block.size() * sizeof(PackedPosition))) break;
+                remaining -= block.size();
+
+                std::unique_lock<std::mutex> lock(reader.mutex);
+                reader.cv.wait(lock, [&]() { return reader.blocks.size() < READ_AHEAD || cancelled; });
+                if (cancelled) return;
+                reader.blocks.push_back(std::move(block));
+                reader.cv.notify_all();
+            }
+        }
+        std::lock_guard<std::mutex> lock(reader.mutex);
+        reader.done = true;
+        reader.cv.notify_all();
+    }
+
+    bool ShardStream::next_block(std::vector<PackedPosition>& block) {
+        for (size_t attempts = 0; attempts < readers.size(); attempts++) {
+            Reader& reader = *readers[next_reader];
+            next_reader = (next_reader + 1) % readers.size();
+            if (reader.exhausted) continue;
+
+            std::unique_lock<std::mutex> lock(reader.mutex);
+            reader.cv.wait(lock, [&]() { return !reader.blocks.empty() || reader.done; });
+            if (reader.blocks.empty()) {
+                reader.exhausted = true;
+                continue;
+            }
+            block = std::move(reader.blocks.front());
+            reader.blocks.pop_front();
+            reader.cv.notify_all();
+            return true;
+        }
+        return false;
+    }
+
+    bool ShardStream::next_batch(torch::data::Example<>& batch) {
+        //top up the shuffle buffer
+        std::vector<PackedPosition> block;
+        while (shuffle_buffer.size() < shuffle_capacity && next_block(block)) {
+            shuffle_buffer.insert(shuffle_buffer.end(), block.begin(), block.end());
+        }
+        if (shuffle_buffer.empty()) return false;
+
+        size_t count = std::min(batch_size, shuffle_buffer.size());
+        batch = decode_batch(count, sparse, augment, epoch, [&](size_t, std::int16_t* features, float& score, int& move) {
+            //draw a random record and fill its slot with the last one
+            size_t pick = rng() % shuffle_buffer.size();
+            PackedPosition record = shuffle_buffer[pick];
+            shuffle_buffer[pick] = shuffle_buffer.back();
+            shuffle_buffer.pop_back();
+            score = record.score;
+            move = packed_move(record);
+            return unpack_sparse(record, features);
+        });
+        return true;
+    }
+
+    ShardStream::Iterator ShardStream::begin() {
+        start_epoch();
+        return Iterator(this);
+    }
+
+    ShardStream::Iterator::Iterator(ShardStream* owner) : stream(owner) {
+        if (stream != nullptr && !stream->next_batch(batch)) stream = nullptr;
+    }
+
+    ShardStream::Iterator& ShardStream::Iterator::operator++() {
+        if (!stream->next_batch(batch)) stream = nullptr;
+        return *this;
+    }
+}
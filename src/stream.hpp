@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <torch/torch.h>
+#include "packed.hpp"
+
+namespace hydra {
+    /**
+     * Streams training batches from a set of packed shard files without loading them. Prefetch threads read shards
+     * sequentially in blocks, and batches are drawn at random from a bounded shuffle buffer, so memory use is
+     * independent of the corpus size. Each prefetch thread owns a fixed subset of the epoch's shards and blocks
+     * are consumed round-robin, so the batch sequence depends only on the seed, never on thread timing.
+     */
+    class ShardStream {
+        private:
+            /**
+             * A prefetch thread and the blocks it has read ahead.
+             */
+            struct Reader {
+                std::vector<size_t> shards;                                                     //indices into shard_paths, in reading order
+                std::deque<std::vector<PackedPosition>> blocks;
+                bool done{ false };
+                bool exhausted{ false };                                                        //done and drained (consumer side)
+                std::mutex mutex;
+                std::condition_variable cv;
+                std::thread thread;
+            };
+
+            std::vector<std::string> shard_paths;
+            size_t total{ 0 };
+            size_t batch_size;
+            size_t shuffle_capacity;
+            int thread_count;
+            std::uint64_t seed;
+            bool sparse;
+            bool augment;
+
+            /**
+             * Current epoch state.
+             */
+            int epoch{ 0 };
+            std::vector<std::unique_ptr<Reader>> readers;
+            std::atomic<bool> cancelled{ false };
+            size_t next_reader{ 0 };
+            std::vector<PackedPosition> shuffle_buffer;
+            std::mt19937_64 rng;
+
+            /**
+             * Prefetch loop of one reader.
+             */
+            void read_shards(Reader& reader);
+
+            /**
+             * Starts the prefetch threads of a new epoch with a seeded shard order.
+             */
+            void start_epoch();
+
+            /**
+             * Stops and joins the prefetch threads.
+             */
+            void stop_readers();
+
+            /**
+             * Takes the next block in round-robin reader order.
+             * @param {std::vector<PackedPosition>&} block - receives the records.
+             * @returns {bool} false once every reader is exhausted.
+             */
+            bool next_block(std::vector<PackedPosition>& block);
+
+        public:
+            /**
+             * Input iterator over the batches of one epoch.
+             */
+            class Iterator {
+                private:
+                    ShardStream* stream;
+                    torch::data::Example<> batch;
+
+                public:
+                    explicit Iterator(ShardStream* owner);
+
+                    torch::data::Example<>& operator*() {
+                        return batch;
+                    }
+
+                    Iterator& operator++();
+
+                    bool operator!=(const Iterator& other) const {
+                        return stream != other.stream;
+                    }
+            };
+
+            /**
+             * @param {const std::string&} path - a directory of packed shards (*.bin), read in name order.
+             * @param {size_t} batch - examples per batch.
+             * @param {size_t} shuffle_size - capacity of the shuffle buffer in examples.
+             * @param {int} threads - number of prefetch threads.
+             * @param {std::uint64_t} random_seed - seed of the shard order and the shuffle.
+             * @param {bool} sparse_input - decode sparse feature lists rather than dense board tensors.
+             * @param {bool} mirror - randomly mirror the files of positions without castling rights.
+             */
+            ShardStream(const std::string& path, size_t batch, size_t shuffle_size, int threads, std::uint64_t random_seed, bool sparse_input, bool mirror);
+
+            ~ShardStream();
+
+            /**
+             * Decodes the next batch.
+             * @param {torch::data::Example<>&} batch - receives the examples.
+             * @returns {bool} false at the end of the epoch.
+             */
+            bool next_batch(torch::data::Example<>& batch);
+
+            /**
+             * Starts a new epoch.
+             * @returns {Iterator} iterator at its first batch.
+             */
+            Iterator begin();
+
+            Iterator end() {
+                return Iterator(nullptr);
+            }
+
+            /**
+             * Number of examples in all shards.
+             * @returns {size_t} corpus size.
+             */
+            size_t size() const {
+                return total;
+            }
+    };
+}
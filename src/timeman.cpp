@@ -0,0 +1,63 @@
+#include "timeman.hpp"
+#include "config.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace hydra {
+    TimeManager::TimeManager() : overhead_ms(config::MOVE_OVERHEAD) {}
+
+    void TimeManager::set_move_overhead(int milliseconds) {
+        overhead_ms = std::max(milliseconds, 0);
+    }
+
+    void TimeManager::start(const libchess::UCIGoParameters& params, libchess::Color side) {
+        start_time = clock::now();
+        bool white = side == libchess::constants::WHITE;
+        const std::optional<int>& time = white ? params.wtime() : params.btime();
+        const std::optional<int>& inc = white ? params.winc() : params.binc();
+
+        ponder_search = params.ponder();
+        timed = !params.infinite() && (params.movetime().has_value() || time.has_value());
+        playouts = std::numeric_limits<int>::max();
+        if (params.nodes().has_value()) {
+            playouts = static_cast<int>(std::min<std::uint64_t>(*params.nodes(), std::numeric_limits<int>::max()));
+        }
+        else if (!timed && !params.infinite()) {
+            //no limits given, search a fixed number of playouts
+            playouts = config::MCTS_ITERATIONS * config::THREAD_CNT;
+        }
+
+        if (params.movetime().has_value()) {
+            soft_ms = hard_ms = std::max(*params.movetime() - overhead_ms, 1);
+        }
+        else if (time.has_value()) {
+            //spread the clock over the remaining moves, spend most of the increment, and allow overrunning the
+            //target a few times over while the best move is unstable
+            double available = std::max(*time - overhead_ms, 1);
+            double moves = std::max(params.movestogo().value_or(config::MOVES_TO_GO), 1);
+            double target = available / moves + inc.value_or(0) * 0.75;
+            soft_ms = std::min(target, available);
+            hard_ms = std::min(target * config::HARD_TIME_RATIO, available);
+        }
+
+        //a ponder search gets its deadlines on ponderhit
+        unbounded.store(params.infinite() || ponder_search, std::memory_order_release);
+        if (!ponder_search) start_clock(start_time);
+    }
+
+    void TimeManager::ponderhit() {
+        if (!pondering()) return;
+        start_clock(clock::now());
+        unbounded.store(false, std::memory_order_release);
+    }
+
+    void TimeManager::start_clock(clock::time_point now) {
+        soft_deadline = now + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(soft_ms));
+        hard_deadline = now + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(hard_ms));
+    }
+
+    double TimeManager::remaining(clock::time_point now) const {
+        clock::time_point deadline = now < soft_deadline ? soft_deadline : hard_deadline;
+        return std::max(std::chrono::duration<double>(deadline - now).count(), 0.0);
+    }
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <Color.h>
+#include <UCIService.h>
+
+namespace hydra {
+    /**
+     * Turns the clock state of a UCI go command into search limits. A search stops at the soft deadline, unless the
+     * best move is unstable, and never runs past the hard deadline. Without any limit in the command, the search
+     * falls back to a fixed number of playouts. A ponder search runs without limits until ponderhit, when the
+     * deadlines start counting from that moment.
+     */
+    class TimeManager {
+        public:
+            using clock = std::chrono::steady_clock;
+
+        private:
+            clock::time_point start_time;
+            clock::time_point soft_deadline;
+            clock::time_point hard_deadline;
+
+            /**
+             * Time allotted to the move (milliseconds), applied when the clock starts.
+             */
+            double soft_ms{ 0 };
+            double hard_ms{ 0 };
+
+            /**
+             * Deadlines apply (clock or movetime search).
+             */
+            bool timed{ false };
+
+            /**
+             * Search until stopped (infinite search, or ponder search before ponderhit). Cleared by the UCI thread on
+             * ponderhit while the search reads it.
+             */
+            std::atomic<bool> unbounded{ false };
+
+            /**
+             * The search was started with go ponder.
+             */
+            bool ponder_search{ false };
+
+            /**
+             * Maximum number of playouts.
+             */
+            int playouts{ 0 };
+
+            /**
+             * Time reserved per move for communication with the GUI (milliseconds).
+             */
+            int overhead_ms;
+
+            /**
+             * Sets the deadlines from the time allotted to the move.
+             * @param {clock::time_point} now - the moment the clock starts.
+             */
+            void start_clock(clock::time_point now);
+
+        public:
+            TimeManager();
+
+            /**
+             * Sets the limits of a new search. The clock starts now, or on ponderhit for a ponder search.
+             * @param {const libchess::UCIGoParameters&} params - the go command.
+             * @param {libchess::Color} side - the side to move.
+             */
+            void start(const libchess::UCIGoParameters& params, libchess::Color side);
+
+            /**
+             * The opponent played the expected move: the ponder search becomes a normal search whose deadlines count
+             * from now. Safe to call while the search runs.
+             */
+            void ponderhit();
+
+            /**
+             * Sets the time reserved per move for communication with the GUI.
+             * @param {int} milliseconds - the move overhead.
+             */
+            void set_move_overhead(int milliseconds);
+
+            /**
+             * Whether the search only ends when stopped.
+             * @returns {bool} true for infinite and ponder searches.
+             */
+            bool infinite() const {
+                return unbounded.load(std::memory_order_acquire);
+            }
+
+            /**
+             * Whether the search is pondering on the opponent's time.
+             * @returns {bool} true for a ponder search before ponderhit.
+             */
+            bool pondering() const {
+                return ponder_search && infinite();
+            }
+
+            /**
+             * Whether the search has deadlines.
+             * @returns {bool} true for clock and movetime searches.
+             */
+            bool has_deadline() const {
+                return timed;
+            }
+
+            /**
+             * Maximum number of playouts of the search.
+             * @returns {int} the playout budget.
+             */
+            int playout_limit() const {
+                return playouts;
+            }
+
+            /**
+             * Whether the search should stop unless the best move is unstable.
+             * @param {clock::time_point} now - the current time.
+             * @returns {bool} true once the soft deadline passed.
+             */
+            bool past_soft(clock::time_point now) const {
+                return timed && now >= soft_deadline;
+            }
+
+            /**
+             * Whether the search must stop.
+             * @param {clock::time_point} now - the current time.
+             * @returns {bool} true once the hard deadline passed.
+             */
+            bool past_hard(clock::time_point now) const {
+                return timed && now >= hard_deadline;
+            }
+
+            /**
+             * Time until the search will normally end: the soft deadline, or once past it, the hard deadline.
+             * @param {clock::time_point} now - the current time.
+             * @returns {double} remaining seconds.
+             */
+            double remaining(clock::time_point now) const;
+
+            /**
+             * Time since the search started.
+             * @param {clock::time_point} now - the current time.
+             * @returns {double} elapsed seconds.
+             */
+            double elapsed(clock::time_point now) const {
+                return std::chrono::duration<double>(now - start_time).count();
+            }
+    };
+}
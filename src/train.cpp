@@ -1,12 +1,220 @@
 #include "train.hpp"
+#include "stream.hpp"
+#include "metrics.hpp"
+#include "parallel.hpp"
+#include "checkpoint.hpp"
+#include "validate.hpp"
+#include <filesystem>
+#include <functional>
 
 namespace hydra{
-    void train(Eval net, const std::string& path) {
-        std::cout << "Training Evaluator..." << std::endl;
-        //load from checkpoint
-        if(config::LOAD_CHECKPOINT) {
-            torch::load(net, config::WEIGHTS_PATH);
+    namespace {
+        /**
+         * Loss terms of the network on a batch: mean squared error of the value, and the cross entropy of the policy
+         * summed over the positions labelled with a best move.
+         * @param {Eval&} net - the value network.
+         * @param {const torch::Tensor&} pos - network inputs.
+         * @param {const torch::Tensor&} target - target evaluations and best moves (see TARGET_SCORE, TARGET_MOVE).
+         * @param {bool} with_policy - also compute the policy terms.
+         * @returns {Validator::Losses} the loss terms.
+         */
+        Validator::Losses loss_terms(Eval& net, const torch::Tensor& pos, const torch::Tensor& target, bool with_policy) {
+            Validator::Losses losses;
+            auto hidden = config::SPARSE_INPUT ? net->first_layer_padded(pos.to(at::kLong)) : net->fc1(pos);
+            losses.value = torch::mse_loss(net->forward_hidden(hidden), target.narrow(1, TARGET_SCORE, 1));
+            if (with_policy) {
+                //unlabelled positions (move -1) are ignored
+                auto moves = target.select(1, TARGET_MOVE).to(at::kLong);
+                losses.labelled = (moves >= 0).sum();
+                losses.policy = torch::nn::functional::cross_entropy(net->forward_policy(hidden), moves,
+                    torch::nn::functional::CrossEntropyFuncOptions().ignore_index(-1).reduction(torch::kSum));
+            }
+            return losses;
+        }
+
+        /**
+         * Training loss of the network on a batch: the value loss plus config::POLICY_WEIGHT times the mean policy
+         * cross entropy over the labelled positions.
+         * @param {Eval&} net - the value network.
+         * @param {const torch::Tensor&} pos - network inputs.
+         * @param {const torch::Tensor&} target - target evaluations and best moves.
+         * @returns {torch::Tensor} the loss.
+         */
+        torch::Tensor batch_loss(Eval& net, const torch::Tensor& pos, const torch::Tensor& target) {
+            Validator::Losses losses = loss_terms(net, pos, target, config::POLICY_WEIGHT > 0);
+            if (!losses.policy.defined()) return losses.value;
+            return losses.value + config::POLICY_WEIGHT * losses.policy / losses.labelled.clamp_min(1);
+        }
+
+        /**
+         * Loss terms of a validation batch. The value loss alone selects the best weights; the policy is reported
+         * separately.
+         */
+        Validator::Losses validation_terms(Eval& net, const torch::Tensor& pos, const torch::Tensor& target) {
+            return loss_terms(net, pos, target, true);
         }
+
+        /**
+         * Train the value network on batches from a loader.
+         * @param {Eval} net - the value network, already on the training device.
+         * @param {Loader&} data_loader - yields the batches of an epoch each time it is iterated.
+         * @param {int} dataset_size - number of examples per epoch.
+         * @param {int} workers - number of loader threads (logged with the metrics).
+         * @param {Validator*} validator - held-out set that selects the best weights, or nullptr to use the training loss.
+         * @param {torch::Device} device - the training device.
+         * @param {std::function<void(int)>} start_epoch - called with each epoch before its batches are loaded, or empty.
+         */
+        template <typename Loader>
+        void train_loop(Eval net, Loader& data_loader, int dataset_size, int workers, Validator* validator, torch::Device device,
+                        const std::function<void(int)>& start_epoch = nullptr) {
+            std::cout << "Train dataset ready.\n";
+
+            //throughput log next to the checkpoint
+            TrainingMetrics metrics(std::string(config::WEIGHTS_PATH) + "training.jsonl", dataset_size, config::BATCH_SIZE, workers,
+                                    device.is_cuda() ? "cuda" : "cpu");
+            //CUDA runs asynchronously; wait for the device so each phase is charged its own time
+            auto lap = [&](TrainingMetrics::Phase phase) {
+                if (device.is_cuda()) torch::cuda::synchronize();
+                metrics.lap(phase);
+            };
+
+            //create gradient optimizer
+            torch::optim::Adam optimizer(net->parameters(), torch::optim::AdamOptions(1e-3));
+
+            //best loss during training
+            float best_mse = std::numeric_limits<float>::max();
+
+            //checkpoints are written in the background; resuming restores the optimizer state too
+            Checkpointer checkpoints(config::WEIGHTS_PATH, config::CHECKPOINTS);
+            int first_epoch = 1;
+            if (config::LOAD_CHECKPOINT) first_epoch = checkpoints.resume(net, optimizer, device, best_mse) + 1;
+            bool policy_trained = net->policy_trained.item<float>() > 0;
+
+            //data-parallel model replicas across the sockets of CPU machines
+            std::unique_ptr<DataParallel> parallel;
+            int replicas = config::TRAIN_REPLICAS > 0 ? config::TRAIN_REPLICAS : static_cast<int>(numa_nodes().size());
+            if (!device.is_cuda() && replicas > 1) {
+                parallel = std::make_unique<DataParallel>(net, batch_loss, replicas);
+                std::printf("Training %d model replicas in parallel.\n", replicas);
+            }
+
+            //validation pass, reported on the console and in the metrics log
+            auto validate = [&](int epoch) {
+                Validator::Result result = validator->run(net, device);
+                metrics.write_validation(epoch, result.loss, result.policy_loss, result.samples, result.seconds);
+                std::printf(" Validation Loss: %f", result.loss);
+                if (result.labelled > 0) std::printf(" Policy Loss: %f", result.policy_loss);
+                std::printf(" (%.0f positions/s)\n", result.samples / std::max(result.seconds, 1e-9));
+                return static_cast<float>(result.loss);
+            };
+
+            std::printf("Training for %ld epochs with a dataset size of %ld and batch size of %ld...\n", config::NUM_EPOCH, dataset_size, config::BATCH_SIZE);
+            //train epochs
+            for (int epoch = first_epoch; epoch <= config::NUM_EPOCH; epoch++) {
+                net->train();
+
+                size_t batch_idx = 0;
+                float mse = 0;
+                int count = 0;
+                int total_batches = 0;
+
+                //minibatching
+                if (start_epoch) start_epoch(epoch);
+                metrics.start_epoch();
+                for (auto& batch : data_loader) {
+                    metrics.lap(TrainingMetrics::LOADER);
+                    //the policy head is marked trained once it sees a labelled position, so the search uses its priors
+                    if (config::POLICY_WEIGHT > 0 && !policy_trained && (batch.target.select(1, TARGET_MOVE) >= 0).any().template item<bool>()) {
+                        torch::NoGradGuard no_grad;
+                        net->policy_trained.fill_(1);
+                        policy_trained = true;
+                    }
+                    auto pos = batch.data.to(device), target = batch.target.to(device);
+                    float mean_loss;
+                    if (parallel) {
+                        mean_loss = parallel->step(pos, target, optimizer, lap);
+                    }
+                    else {
+                        //calculate loss
+                        optimizer.zero_grad();
+                        auto loss = batch_loss(net, pos, target);
+                        lap(TrainingMetrics::FORWARD);
+
+                        //do gradient step
+                        loss.backward();
+                        lap(TrainingMetrics::BACKWARD);
+                        optimizer.step();
+                        mean_loss = loss.template item<float>();
+                        lap(TrainingMetrics::STEP);
+                    }
+
+                    mse += mean_loss;
+                    metrics.end_batch(batch.data.size(0), mean_loss);
+
+                    batch_idx++;
+                    total_batches += batch.data.size(0);
+                    if (batch_idx % config::LOG_INTERVAL == 0) {
+                        std::printf(
+                            "\rTrain Epoch: %d/%ld [%5d/%5d] Loss: %.4f (%.0f samples/s, %.0f%% waiting on loader)",
+                            epoch,
+                            config::NUM_EPOCH,
+                            total_batches,
+                            dataset_size,
+                            mean_loss,
+                            metrics.samples_per_second(),
+                            metrics.loader_fraction() * 100
+                        );
+                        metrics.write_interval(epoch);
+                    }
+                    if (validator != nullptr && config::VALID_INTERVAL > 0 && batch_idx % config::VALID_INTERVAL == 0) {
+                        std::printf("\n");
+                        validate(epoch);
+                    }
+
+                    count++;
+                }
+                metrics.end_epoch(epoch);
+
+                mse /= (float)count;
+                printf(" Mean Loss: %f\n", mse);
+
+                //checkpoint every epoch, and replace the engine's weights when the (validation) loss improves
+                float selection_mse = validator != nullptr ? validate(epoch) : mse;
+                bool best = selection_mse < best_mse;
+                if (best) best_mse = selection_mse;
+                checkpoints.save(net, optimizer, epoch, best_mse, best);
+            }
+            checkpoints.wait();
+
+            std::cout << "Training completed.\n";
+        }
+
+        /**
+         * Train the value network on a random access dataset.
+         * @param {Eval} net - the value network, already on the training device.
+         * @param {Dataset} dataset - the training examples.
+         * @param {Validator*} validator - held-out set, or nullptr.
+         * @param {torch::Device} device - the training device.
+         */
+        template <typename Dataset>
+        void train_on(Eval net, Dataset dataset, Validator* validator, torch::Device device) {
+            int dataset_size = dataset.size().value();
+            //the loader takes the dataset, the epoch counter of its augmentation stays reachable
+            std::shared_ptr<std::atomic<int>> augment_epoch = dataset.epoch_counter();
+
+            //setup dataloader (datasets decode whole batches, so no per example stacking)
+            auto data_loader = torch::data::make_data_loader<torch::data::samplers::RandomSampler>(
+                std::move(dataset),
+                torch::data::DataLoaderOptions()
+                    .batch_size(config::BATCH_SIZE)
+                    .workers(config::LOADER_WORKERS));
+            train_loop(net, *data_loader, dataset_size, config::LOADER_WORKERS, validator, device,
+                       [&](int epoch) { augment_epoch->store(epoch, std::memory_order_relaxed); });
+        }
+    }
+
+    void train(Eval net, const std::string& path, const std::string& validation_path) {
+        std::cout << "Training Evaluator..." << std::endl;
         //choose training device (GPU if supported, otherwise CPU)
         torch::DeviceType device_type;
         if(torch::cuda::is_available()) {
@@ -21,80 +229,31 @@ namespace hydra{
         //move model to device
         net->to(device);
         
-        //load dataset
-        std::cout << "Loading train dataset...\n";
-        auto data_set = PositionDataset(path).map(torch::data::transforms::Stack<>());
-        int dataset_size = data_set.size().value();
-
-        //setup dataloader
-        auto data_loader = torch::data::make_data_loader<torch::data::samplers::RandomSampler>(
-            std::move(data_set),
-            torch::data::DataLoaderOptions()
-                .batch_size(config::BATCH_SIZE)
-                .workers(4));
-        std::cout << "Train dataset ready.\n";
-
-        //create gradient optimizer
-        torch::optim::Adam optimizer(net->parameters(), torch::optim::AdamOptions(1e-3));
-
-        //best loss during training
-        float best_mse = std::numeric_limits<float>::max();
-        
-        std::printf("Training for %ld epochs with a dataset size of %ld and batch size of %ld...\n", config::NUM_EPOCH, dataset_size, config::BATCH_SIZE);
-        //train epochs
-        for (int epoch = 1; epoch <= config::NUM_EPOCH; epoch++) {
-            net->train();
-
-            size_t batch_idx = 0;
-            float mse = 0;
-            int count = 0;
-            int total_batches = 0;
-
-            //minibatching
-            for (auto& batch : *data_loader) {
-                auto pos = batch.data.to(device), score = batch.target.to(device);
-                
-                //calculate loss
-                optimizer.zero_grad();
-                auto output = net->forward(pos);
-                auto loss = torch::mse_loss(output, score);
-                
-                //do gradient step
-                loss.backward();
-                optimizer.step();
-
-                mse += loss.template item<float>();
-
-                batch_idx++;
-                total_batches += batch.data.size(0);
-                if (batch_idx % config::LOG_INTERVAL == 0) {
-                    std::printf(
-                        "\rTrain Epoch: %d/%ld [%5d/%5d] Loss: %.4f",
-                        epoch,
-                        config::NUM_EPOCH,
-                        total_batches,
-                        dataset_size,
-                        loss.template item<float>()
-                    );
-                }
-
-                count++;
+        //held-out examples are never augmented
+        std::unique_ptr<Validator> validator;
+        if (!validation_path.empty()) {
+            std::cout << "Loading validation dataset...\n";
+            if (validation_path.size() >= 4 && validation_path.compare(validation_path.size() - 4, 4, ".bin") == 0) {
+                validator = std::make_unique<Validator>(std::make_shared<PackedDataset>(validation_path, config::SPARSE_INPUT, false),
+                                                        validation_terms, config::VALID_THREADS, config::VALID_BATCH);
             }
-
-            mse /= (float)count;
-            printf(" Mean Loss: %f\n", mse);
-
-            //save best model
-            if (mse < best_mse) {
-                //ensure model is on CPU before saving
-                net->to(torch::kCPU);
-                torch::save(net, std::string(config::WEIGHTS_PATH) + "evaluator.pt");
-                //return back to original device
-                net->to(device);
-                best_mse = mse;
+            else {
+                validator = std::make_unique<Validator>(std::make_shared<PositionDataset>(validation_path, config::SPARSE_INPUT, false),
+                                                        validation_terms, config::VALID_THREADS, config::VALID_BATCH);
             }
         }
 
-        std::cout << "Training completed.\n";
+        //load dataset (directories of packed shards are streamed, packed files are memory mapped, anything else is parsed as CSV)
+        std::cout << "Loading train dataset...\n";
+        if (std::filesystem::is_directory(path)) {
+            ShardStream stream(path, config::BATCH_SIZE, config::SHUFFLE_BUFFER, config::STREAM_THREADS, config::SEED, config::SPARSE_INPUT, config::MIRROR_AUGMENT);
+            train_loop(net, stream, static_cast<int>(stream.size()), config::STREAM_THREADS, validator.get(), device);
+        }
+        else if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".bin") == 0) {
+            train_on(net, PackedDataset(path, config::SPARSE_INPUT, config::MIRROR_AUGMENT), validator.get(), device);
+        }
+        else {
+            train_on(net, PositionDataset(path, config::SPARSE_INPUT, config::MIRROR_AUGMENT), validator.get(), device);
+        }
     }
 }
\ No newline at end of file
@@ -9,6 +9,8 @@ namespace hydra {
      * Train the value network on game results.
      * @param {Eval} net - the value network to train.
      * @param {const std::string&} path - path to the dataset.
+     * @param {const std::string&} validation_path - path to a held-out dataset (CSV or packed file) used to pick the
+     * best weights, or empty to pick them by training loss.
      */
-    void train(Eval net, const std::string& path);
+    void train(Eval net, const std::string& path, const std::string& validation_path = "");
 }
\ No newline at end of file
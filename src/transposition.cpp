@@ -0,0 +1,56 @@
+#include "transposition.hpp"
+
+namespace hydra {
+    void TransTable::resize(size_t bytes) {
+        size_t count = 1;
+        while (count * 2 * sizeof(Entry) <= bytes) count *= 2;
+        entries = std::make_unique<Entry[]>(count);
+        mask = count - 1;
+        generation = 1;
+    }
+
+    size_t TransTable::bytes() const {
+        return entries ? (mask + 1) * sizeof(Entry) : 0;
+    }
+
+    void TransTable::clear() {
+        generation++;
+        //wrapped around: old tags could look current again
+        if (generation == 0) {
+            for (size_t i = 0; i <= mask; i++) {
+                entries[i].data.store(0, std::memory_order_relaxed);
+            }
+            generation = 1;
+        }
+    }
+
+    pool_index TransTable::find(libchess::Position::hash_type hash) const {
+        for (int i = 0; i < PROBES; i++) {
+            const Entry& entry = entries[(hash + i) & mask];
+            std::uint64_t data = entry.data.load(std::memory_order_acquire);
+            //no deletions within a generation, so an empty slot ends the probe sequence
+            if ((data >> 32) != generation) return NULL_INDEX;
+            pool_index node = static_cast<pool_index>(data);
+            if (node != BUSY && entry.key.load(std::memory_order_relaxed) == hash) return node;
+        }
+        return NULL_INDEX;
+    }
+
+    pool_index TransTable::insert(libchess::Position::hash_type hash, pool_index node) {
+        for (int i = 0; i < PROBES; i++) {
+            Entry& entry = entries[(hash + i) & mask];
+            std::uint64_t data = entry.data.load(std::memory_order_acquire);
+            while ((data >> 32) != generation) {
+                //claim the empty slot, then publish the key before the node
+                if (entry.data.compare_exchange_weak(data, tag(BUSY), std::memory_order_acq_rel)) {
+                    entry.key.store(hash, std::memory_order_relaxed);
+                    entry.data.store(tag(node), std::memory_order_release);
+                    return node;
+                }
+            }
+            pool_index existing = static_cast<pool_index>(data);
+            if (existing != BUSY && entry.key.load(std::memory_order_relaxed) == hash) return existing;
+        }
+        return node;
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <Position.h>
+#include "pool.hpp"
+
+namespace hydra {
+    /**
+     * Maps position hashes to search nodes, so that a position reached by different move orders shares a single node
+     * and the search tree becomes a DAG. Lock-free open addressing with a short probe sequence. Entries are tagged
+     * with a generation so the table is cleared in constant time.
+     */
+    class TransTable {
+        private:
+            struct Entry {
+                std::atomic<std::uint64_t> key{ 0 };                                            //position hash
+                std::atomic<std::uint64_t> data{ 0 };                                           //generation << 32 | node index
+            };
+
+            /**
+             * Slots examined per lookup.
+             */
+            static constexpr int PROBES = 8;
+
+            /**
+             * Node index of a slot that is being written.
+             */
+            static constexpr pool_index BUSY = NULL_INDEX;
+
+            std::unique_ptr<Entry[]> entries;
+            size_t mask{ 0 };
+
+            /**
+             * Current generation. Entries of older generations are empty.
+             */
+            std::uint32_t generation{ 1 };
+
+            std::uint64_t tag(pool_index node) const {
+                return (static_cast<std::uint64_t>(generation) << 32) | node;
+            }
+
+        public:
+            /**
+             * Allocates the table and clears it.
+             * @param {size_t} bytes - memory to use. Rounded down to a power of two number of entries.
+             */
+            void resize(size_t bytes);
+
+            /**
+             * Memory used by the table.
+             * @returns {size_t} size in bytes.
+             */
+            size_t bytes() const;
+
+            /**
+             * Empties the table in constant time. Must not be called while other threads use the table.
+             */
+            void clear();
+
+            /**
+             * Looks up the node of a position.
+             * @param {libchess::Position::hash_type} hash - position hash.
+             * @returns {pool_index} the node, or NULL_INDEX if the position is not in the table.
+             */
+            pool_index find(libchess::Position::hash_type hash) const;
+
+            /**
+             * Records the node of a position unless the position already has one.
+             * @param {libchess::Position::hash_type} hash - position hash.
+             * @param {pool_index} node - the new node.
+             * @returns {pool_index} the node the position maps to after the call. This is node itself if the table
+             * has no room for it.
+             */
+            pool_index insert(libchess::Position::hash_type hash, pool_index node);
+    };
+}
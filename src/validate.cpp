@@ -0,0 +1,48 @@
+#include "validate.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+#include <thread>
+
+namespace hydra {
+    Validator::Result Validator::run(Eval net, torch::Device device) {
+        auto start = std::chrono::steady_clock::now();
+        bool training = net->is_training();
+        net->eval();
+
+        //threads claim batches in order until the set is exhausted
+        std::atomic<size_t> next{ 0 };
+        std::vector<double> errors(threads, 0), policy_errors(threads, 0);
+        std::vector<size_t> labelled(threads, 0);
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; t++) {
+            pool.emplace_back([&, t]() {
+                torch::NoGradGuard no_grad;
+                std::vector<size_t> indices;
+                for (size_t first = next.fetch_add(batch_size); first < count; first = next.fetch_add(batch_size)) {
+                    size_t rows = std::min(batch_size, count - first);
+                    indices.resize(rows);
+                    std::iota(indices.begin(), indices.end(), first);
+                    torch::data::Example<> batch = get_batch(indices);
+                    Losses losses = loss_fn(net, batch.data.to(device), batch.target.to(device));
+                    errors[t] += losses.value.item<double>() * rows;
+                    if (losses.policy.defined()) {
+                        policy_errors[t] += losses.policy.item<double>();
+                        labelled[t] += static_cast<size_t>(losses.labelled.item<int64_t>());
+                    }
+                }
+            });
+        }
+        for (auto& thread : pool) {
+            thread.join();
+        }
+
+        if (training) net->train();
+        double total = std::accumulate(errors.begin(), errors.end(), 0.0);
+        double policy_total = std::accumulate(policy_errors.begin(), policy_errors.end(), 0.0);
+        size_t labelled_total = std::accumulate(labelled.begin(), labelled.end(), size_t(0));
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return { count > 0 ? total / count : 0, labelled_total > 0 ? policy_total / labelled_total : 0, count, labelled_total, seconds };
+    }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <torch/torch.h>
+#include "neural.hpp"
+
+namespace hydra {
+    /**
+     * Scores the value network on a held-out dataset. A pool of threads decodes and evaluates large batches without
+     * gradients and with dropout off, so a pass over the validation set is much faster than a training epoch.
+     */
+    class Validator {
+        public:
+            /**
+             * Loss terms of a network on a batch.
+             */
+            struct Losses {
+                torch::Tensor value;        //mean squared error of the value
+                torch::Tensor policy;       //policy cross entropy summed over the labelled examples (undefined if not computed)
+                torch::Tensor labelled;     //examples labelled with a best move
+            };
+
+            /**
+             * Loss terms of a network on a batch: (network, inputs, targets).
+             */
+            using LossFn = std::function<Losses(Eval&, const torch::Tensor&, const torch::Tensor&)>;
+
+            /**
+             * Outcome of a validation pass.
+             */
+            struct Result {
+                double loss;                //mean squared error of the value per example
+                double policy_loss;         //mean policy cross entropy per labelled example (0 without labels)
+                size_t samples;             //examples evaluated
+                size_t labelled;            //examples labelled with a best move
+                double seconds;             //wall time of the pass
+            };
+
+        private:
+            /**
+             * Decodes a batch of validation examples.
+             */
+            std::function<torch::data::Example<>(const std::vector<size_t>&)> get_batch;
+            size_t count;
+            LossFn loss_fn;
+            int threads;
+            size_t batch_size;
+
+        public:
+            /**
+             * @param {std::shared_ptr<Dataset>} dataset - validation examples (a batch dataset; never augmented).
+             * @param {LossFn} loss - loss terms.
+             * @param {int} thread_count - evaluation threads.
+             * @param {size_t} batch - examples per evaluation batch.
+             */
+            template <typename Dataset>
+            Validator(std::shared_ptr<Dataset> dataset, LossFn loss, int thread_count, size_t batch)
+                : get_batch([dataset](const std::vector<size_t>& indices) { return dataset->get_batch(indices); }),
+                  count(dataset->size().value()), loss_fn(std::move(loss)), threads(std::max(thread_count, 1)), batch_size(batch) {}
+
+            /**
+             * Number of validation examples.
+             * @returns {size_t} dataset size.
+             */
+            size_t size() const {
+                return count;
+            }
+
+            /**
+             * Evaluates the network on the whole validation set. The network's training mode is restored afterwards.
+             * @param {Eval} net - the value network.
+             * @param {torch::Device} device - the device the network is on.
+             * @returns {Result} validation value loss, policy loss and throughput.
+             */
+            Result run(Eval net, torch::Device device);
+    };
+}